@@ -2,12 +2,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <locale.h>
+#include <stdint.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #define PAGE_SIZE 20
-#define MAX_RECORDS 4000
 #define NAME_LEN 32
 #define STREET_LEN 18
 #define DATE_LEN 10
+#define RECORD_SIZE (NAME_LEN + STREET_LEN + 2 * sizeof(short int) + DATE_LEN)
+#define RECORD_TEXT_MAX 384
 
 typedef struct Record {
     char name[NAME_LEN];
@@ -17,54 +30,163 @@ typedef struct Record {
     char date[DATE_LEN];
 } Record;
 
-// Таблица преобразования CP866 -> UTF-8 для русских букв
-const char* cp866_to_utf8(unsigned char c) {
-    switch (c) {
-        // Заглавные буквы
-        case 0x80: return "А"; case 0x81: return "Б"; case 0x82: return "В"; case 0x83: return "Г";
-        case 0x84: return "Д"; case 0x85: return "Е"; case 0x86: return "Ж"; case 0x87: return "З";
-        case 0x88: return "И"; case 0x89: return "Й"; case 0x8A: return "К"; case 0x8B: return "Л";
-        case 0x8C: return "М"; case 0x8D: return "Н"; case 0x8E: return "О"; case 0x8F: return "П";
-        case 0x90: return "Р"; case 0x91: return "С"; case 0x92: return "Т"; case 0x93: return "У";
-        case 0x94: return "Ф"; case 0x95: return "Х"; case 0x96: return "Ц"; case 0x97: return "Ч";
-        case 0x98: return "Ш"; case 0x99: return "Щ"; case 0x9A: return "Ъ"; case 0x9B: return "Ы";
-        case 0x9C: return "Ь"; case 0x9D: return "Э"; case 0x9E: return "Ю"; case 0x9F: return "Я";
-        
-        // Строчные буквы
-        case 0xA0: return "а"; case 0xA1: return "б"; case 0xA2: return "в"; case 0xA3: return "г";
-        case 0xA4: return "д"; case 0xA5: return "е"; case 0xA6: return "ж"; case 0xA7: return "з";
-        case 0xA8: return "и"; case 0xA9: return "й"; case 0xAA: return "к"; case 0xAB: return "л";
-        case 0xAC: return "м"; case 0xAD: return "н"; case 0xAE: return "о"; case 0xAF: return "п";
-        case 0xE0: return "р"; case 0xE1: return "с"; case 0xE2: return "т"; case 0xE3: return "у";
-        case 0xE4: return "ф"; case 0xE5: return "х"; case 0xE6: return "ц"; case 0xE7: return "ч";
-        case 0xE8: return "ш"; case 0xE9: return "щ"; case 0xEA: return "ъ"; case 0xEB: return "ы";
-        case 0xEC: return "ь"; case 0xED: return "э"; case 0xEE: return "ю"; case 0xEF: return "я";
-        
-        // Специальные символы
-        case 0xF0: return "№"; case 0xF1: return "ё"; case 0xF2: return "ё";
-        
-        default: return NULL;
+// Номер младшего единичного бита (bits != 0)
+static inline int lowest_bit(unsigned int bits) {
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, bits);
+    return (int)index;
+#else
+    int index = 0;
+    while (!(bits & 1u)) {
+        bits >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+// Кодовые точки Unicode для байтов CP866 0x80-0xFF (нижняя половина - ASCII)
+static const uint16_t cp866_codes[128] = {
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+    0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040E, 0x045E,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x2116, 0x00A4, 0x25A0, 0x00A0
+};
+
+// Готовая UTF-8 последовательность для каждого байта CP866
+typedef struct {
+    char bytes[3];
+    unsigned char length;
+} Utf8Char;
+
+static Utf8Char cp866_utf8[256];
+
+void init_cp866_table(void) {
+    for (int c = 0; c < 0x80; c++) {
+        cp866_utf8[c].bytes[0] = (char)c;
+        cp866_utf8[c].length = 1;
+    }
+    for (int c = 0x80; c < 0x100; c++) {
+        uint16_t code = cp866_codes[c - 0x80];
+        Utf8Char* entry = &cp866_utf8[c];
+        if (code < 0x800) {
+            entry->bytes[0] = (char)(0xC0 | code >> 6);
+            entry->bytes[1] = (char)(0x80 | (code & 0x3F));
+            entry->length = 2;
+        } else {
+            entry->bytes[0] = (char)(0xE0 | code >> 12);
+            entry->bytes[1] = (char)(0x80 | (code >> 6 & 0x3F));
+            entry->bytes[2] = (char)(0x80 | (code & 0x3F));
+            entry->length = 3;
+        }
+    }
+}
+
+// Перекодирование length байт CP866 в UTF-8. В out должно быть место для
+// 3 * length байт. Блоки из одних ASCII копируются по 16 (SSE2) или 32 (AVX2)
+// байта; блок, где есть хоть одна буква кириллицы, целиком идет через таблицу.
+size_t cp866_to_utf8_bulk(const char* input, size_t length, char* output) {
+    const unsigned char* in = (const unsigned char*)input;
+    size_t i = 0;
+    size_t n = 0;
+    
+#if defined(__AVX2__)
+    while (i + 32 <= length) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(in + i));
+        if (_mm256_movemask_epi8(block) == 0) {
+            _mm256_storeu_si256((__m256i*)(output + n), block);
+            i += 32;
+            n += 32;
+            continue;
+        }
+        for (size_t end = i + 32; i < end; i++) {
+            const Utf8Char* entry = &cp866_utf8[in[i]];
+            memcpy(output + n, entry->bytes, 3);
+            n += entry->length;
+        }
     }
+#elif defined(USE_SSE2)
+    while (i + 16 <= length) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(in + i));
+        if (_mm_movemask_epi8(block) == 0) {
+            _mm_storeu_si128((__m128i*)(output + n), block);
+            i += 16;
+            n += 16;
+            continue;
+        }
+        for (size_t end = i + 16; i < end; i++) {
+            const Utf8Char* entry = &cp866_utf8[in[i]];
+            memcpy(output + n, entry->bytes, 3);
+            n += entry->length;
+        }
+    }
+#endif
+    
+    // Скалярный хвост (и полный проход без SIMD)
+    for (; i < length; i++) {
+        const Utf8Char* entry = &cp866_utf8[in[i]];
+        memcpy(output + n, entry->bytes, 3);
+        n += entry->length;
+    }
+    return n;
 }
 
 void convert_cp866_to_utf8(const char* input, char* output, int max_len) {
-    int out_index = 0;
-    for (int i = 0; i < max_len && input[i] != '\0' && out_index < max_len * 3; i++) {
-        unsigned char c = (unsigned char)input[i];
-        const char* utf8_char = cp866_to_utf8(c);
+    const char* end = memchr(input, '\0', (size_t)max_len);
+    size_t length = end ? (size_t)(end - input) : (size_t)max_len;
+    output[cp866_to_utf8_bulk(input, length, output)] = '\0';
+}
+
+// Обратное преобразование через ту же таблицу: до max_len символов UTF-8
+// переводятся в CP866, символы вне кодировки заменяются на '?'
+int utf8_to_cp866(const char* input, char* output, int max_len) {
+    const unsigned char* in = (const unsigned char*)input;
+    int count = 0;
+    while (*in && count < max_len) {
+        uint32_t code;
+        if (in[0] < 0x80) {
+            code = *in++;
+        } else if ((in[0] & 0xE0) == 0xC0 && (in[1] & 0xC0) == 0x80) {
+            code = (uint32_t)(in[0] & 0x1F) << 6 | (in[1] & 0x3F);
+            in += 2;
+        } else if ((in[0] & 0xF0) == 0xE0 && (in[1] & 0xC0) == 0x80 && (in[2] & 0xC0) == 0x80) {
+            code = (uint32_t)(in[0] & 0x0F) << 12 | (uint32_t)(in[1] & 0x3F) << 6 | (in[2] & 0x3F);
+            in += 3;
+        } else {
+            code = '?';
+            in++;
+        }
         
-        if (utf8_char != NULL) {
-            int j = 0;
-            while (utf8_char[j] != '\0' && out_index < max_len * 3 - 1) {
-                output[out_index++] = utf8_char[j++];
-            }
-        } else if (c < 0x80) {
-            output[out_index++] = c;
+        char c = '?';
+        if (code < 0x80) {
+            c = (char)code;
         } else {
-            output[out_index++] = '?';
+            for (int j = 0; j < 128; j++) {
+                if (cp866_codes[j] == code) {
+                    c = (char)(0x80 + j);
+                    break;
+                }
+            }
         }
+        output[count++] = c;
     }
-    output[out_index] = '\0';
+    output[count] = '\0';
+    return count;
 }
 
 int string_compare(const char* s1, const char* s2, int max_len) {
@@ -125,10 +247,28 @@ Record* load_database(const char* filename, int* count) {
         return NULL;
     }
     
-    Record* records = malloc(MAX_RECORDS * sizeof(Record));
+    // Количество записей определяется размером файла
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    
+    if (file_size <= 0 || file_size % RECORD_SIZE != 0) {
+        printf("Ошибка: размер файла %s не кратен размеру записи (%d байт)\n",
+               filename, (int)RECORD_SIZE);
+        fclose(file);
+        return NULL;
+    }
+    
+    int max_records = (int)(file_size / RECORD_SIZE);
+    Record* records = malloc((size_t)max_records * sizeof(Record));
+    if (!records) {
+        printf("Ошибка: недостаточно памяти для %d записей\n", max_records);
+        fclose(file);
+        return NULL;
+    }
     *count = 0;
     
-    while (*count < MAX_RECORDS) {
+    while (*count < max_records) {
         if (fread(records[*count].name, 1, NAME_LEN, file) != NAME_LEN) break;
         if (fread(records[*count].street, 1, STREET_LEN, file) != STREET_LEN) break;
         if (fread(&records[*count].house, sizeof(short int), 1, file) != 1) break;
@@ -153,7 +293,8 @@ void trim_spaces(char* str, int len) {
     }
 }
 
-void display_record(Record* record) {
+// Текст записи в UTF-8, как его выводит меню; возвращает длину
+int format_record(const Record* record, char* out) {
     char temp_name[NAME_LEN * 3 + 1];
     char temp_street[STREET_LEN * 3 + 1];
     char temp_date[DATE_LEN * 3 + 1];
@@ -166,112 +307,149 @@ void display_record(Record* record) {
     trim_spaces(temp_street, strlen(temp_street));
     trim_spaces(temp_date, strlen(temp_date));
     
-    printf("ФИО: %s\n", temp_name);
-    printf("Улица: %s\n", temp_street);
-    printf("Дом: %d\n", record->house);
-    printf("Квартира: %d\n", record->apartment);
-    printf("Дата: %s\n", temp_date);
-    printf("---\n");
+    return snprintf(out, RECORD_TEXT_MAX, "ФИО: %s\nУлица: %s\nДом: %d\nКвартира: %d\nДата: %s\n---\n",
+                    temp_name, temp_street, record->house, record->apartment, temp_date);
+}
+
+// Перекодированный текст записей: каждая запись переводится в UTF-8
+// один раз, при первом показе
+typedef struct {
+    char** text;
+    int count;
+} DisplayCache;
+
+void free_display_cache(DisplayCache* cache) {
+    if (cache->text) {
+        for (int i = 0; i < cache->count; i++) free(cache->text[i]);
+        free(cache->text);
+    }
+    cache->text = NULL;
+    cache->count = 0;
+}
+
+const char* record_text(DisplayCache* cache, Record* records, int count, int i) {
+    static char scratch[RECORD_TEXT_MAX];
+    if (!cache->text) {
+        cache->text = calloc((size_t)count, sizeof(char*));
+        cache->count = cache->text ? count : 0;
+    }
+    if (i >= cache->count) {
+        format_record(&records[i], scratch);
+        return scratch;
+    }
+    if (!cache->text[i]) {
+        char text[RECORD_TEXT_MAX];
+        int length = format_record(&records[i], text);
+        cache->text[i] = malloc((size_t)length + 1);
+        if (!cache->text[i]) {
+            memcpy(scratch, text, (size_t)length + 1);
+            return scratch;
+        }
+        memcpy(cache->text[i], text, (size_t)length + 1);
+    }
+    return cache->text[i];
 }
 
-void display_records_page(Record* records, int count, int start_index, const char* title) {
-    printf("\n=== %s ===\n", title);
+void display_record(DisplayCache* cache, Record* records, int count, int i) {
+    fputs(record_text(cache, records, count, i), stdout);
+}
+
+// Страница собирается целиком и выводится одной записью в stdout
+void display_records_page(DisplayCache* cache, Record* records, int count, int start_index, const char* title) {
+    static char page[PAGE_SIZE * (RECORD_TEXT_MAX + 32) + 256];
     int end_index = start_index + PAGE_SIZE;
     if (end_index > count) end_index = count;
     
+    int size = sprintf(page, "\n=== %s ===\n", title);
     for (int i = start_index; i < end_index; i++) {
-        printf("Запись %d:\n", i + 1);
-        display_record(&records[i]);
+        size += sprintf(page + size, "Запись %d:\n", i + 1);
+        const char* text = record_text(cache, records, count, i);
+        size_t length = strlen(text);
+        memcpy(page + size, text, length);
+        size += (int)length;
     }
+    size += sprintf(page + size, "Показано записей: %d-%d из %d\n",
+                    start_index + 1, end_index, count);
     
-    printf("Показано записей: %d-%d из %d\n", 
-           start_index + 1, end_index, count);
+    fwrite(page, 1, (size_t)size, stdout);
+    fflush(stdout);
 }
 
-int search_by_street_prefix(Record* records, int count, const char* prefix, int** results) {
-    int found_count = 0;
-    int* indices = malloc(count * sizeof(int));
+// Растущий буфер номеров найденных записей
+typedef struct {
+    int* data;
+    int size;
+    int capacity;
+} IndexBuffer;
+
+int push_index(IndexBuffer* buffer, int index) {
+    if (buffer->size == buffer->capacity) {
+        int capacity = buffer->capacity ? buffer->capacity * 2 : 64;
+        int* data = realloc(buffer->data, (size_t)capacity * sizeof(int));
+        if (!data) return 0;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    buffer->data[buffer->size++] = index;
+    return 1;
+}
+
+// Первые 4 байта поля street записи i (младший байт - первая буква)
+static inline uint32_t street_head(const Record* records, int i) {
+    uint32_t head;
+    memcpy(&head, records[i].street, sizeof(head));
+    return head;
+}
+
+// Векторный поиск (AVX2): за одну инструкцию сравниваются префиксы 8 записей.
+// Без AVX2 остается скалярный цикл: записи по 64 байта, и сборка SSE2-вектора
+// из четырех отдельных загрузок ничего не выигрывает.
+int scan_street_prefix(const Record* records, int count, const char* prefix, IndexBuffer* out) {
+    uint32_t key = (unsigned char)prefix[0] |
+                   ((uint32_t)(unsigned char)prefix[1] << 8) |
+                   ((uint32_t)(unsigned char)prefix[2] << 16);
+    const uint32_t mask = 0x00FFFFFF;
+    int i = 0;
     
-    char cp866_prefix[4] = {0};
-    for (int i = 0; i < 3 && prefix[i] != '\0'; i++) {
-        if (prefix[i] == 'А') cp866_prefix[i] = 0x80;
-        else if (prefix[i] == 'Б') cp866_prefix[i] = 0x81;
-        else if (prefix[i] == 'В') cp866_prefix[i] = 0x82;
-        else if (prefix[i] == 'Г') cp866_prefix[i] = 0x83;
-        else if (prefix[i] == 'Д') cp866_prefix[i] = 0x84;
-        else if (prefix[i] == 'Е') cp866_prefix[i] = 0x85;
-        else if (prefix[i] == 'Ж') cp866_prefix[i] = 0x86;
-        else if (prefix[i] == 'З') cp866_prefix[i] = 0x87;
-        else if (prefix[i] == 'И') cp866_prefix[i] = 0x88;
-        else if (prefix[i] == 'Й') cp866_prefix[i] = 0x89;
-        else if (prefix[i] == 'К') cp866_prefix[i] = 0x8A;
-        else if (prefix[i] == 'Л') cp866_prefix[i] = 0x8B;
-        else if (prefix[i] == 'М') cp866_prefix[i] = 0x8C;
-        else if (prefix[i] == 'Н') cp866_prefix[i] = 0x8D;
-        else if (prefix[i] == 'О') cp866_prefix[i] = 0x8E;
-        else if (prefix[i] == 'П') cp866_prefix[i] = 0x8F;
-        else if (prefix[i] == 'Р') cp866_prefix[i] = 0x90;
-        else if (prefix[i] == 'С') cp866_prefix[i] = 0x91;
-        else if (prefix[i] == 'Т') cp866_prefix[i] = 0x92;
-        else if (prefix[i] == 'У') cp866_prefix[i] = 0x93;
-        else if (prefix[i] == 'Ф') cp866_prefix[i] = 0x94;
-        else if (prefix[i] == 'Х') cp866_prefix[i] = 0x95;
-        else if (prefix[i] == 'Ц') cp866_prefix[i] = 0x96;
-        else if (prefix[i] == 'Ч') cp866_prefix[i] = 0x97;
-        else if (prefix[i] == 'Ш') cp866_prefix[i] = 0x98;
-        else if (prefix[i] == 'Щ') cp866_prefix[i] = 0x99;
-        else if (prefix[i] == 'Ъ') cp866_prefix[i] = 0x9A;
-        else if (prefix[i] == 'Ы') cp866_prefix[i] = 0x9B;
-        else if (prefix[i] == 'Ь') cp866_prefix[i] = 0x9C;
-        else if (prefix[i] == 'Э') cp866_prefix[i] = 0x9D;
-        else if (prefix[i] == 'Ю') cp866_prefix[i] = 0x9E;
-        else if (prefix[i] == 'Я') cp866_prefix[i] = 0x9F;
-        else if (prefix[i] == 'а') cp866_prefix[i] = 0xA0;
-        else if (prefix[i] == 'б') cp866_prefix[i] = 0xA1;
-        else if (prefix[i] == 'в') cp866_prefix[i] = 0xA2;
-        else if (prefix[i] == 'г') cp866_prefix[i] = 0xA3;
-        else if (prefix[i] == 'д') cp866_prefix[i] = 0xA4;
-        else if (prefix[i] == 'е') cp866_prefix[i] = 0xA5;
-        else if (prefix[i] == 'ж') cp866_prefix[i] = 0xA6;
-        else if (prefix[i] == 'з') cp866_prefix[i] = 0xA7;
-        else if (prefix[i] == 'и') cp866_prefix[i] = 0xA8;
-        else if (prefix[i] == 'й') cp866_prefix[i] = 0xA9;
-        else if (prefix[i] == 'к') cp866_prefix[i] = 0xAA;
-        else if (prefix[i] == 'л') cp866_prefix[i] = 0xAB;
-        else if (prefix[i] == 'м') cp866_prefix[i] = 0xAC;
-        else if (prefix[i] == 'н') cp866_prefix[i] = 0xAD;
-        else if (prefix[i] == 'о') cp866_prefix[i] = 0xAE;
-        else if (prefix[i] == 'п') cp866_prefix[i] = 0xAF;
-        else if (prefix[i] == 'р') cp866_prefix[i] = 0xE0;
-        else if (prefix[i] == 'с') cp866_prefix[i] = 0xE1;
-        else if (prefix[i] == 'т') cp866_prefix[i] = 0xE2;
-        else if (prefix[i] == 'у') cp866_prefix[i] = 0xE3;
-        else if (prefix[i] == 'ф') cp866_prefix[i] = 0xE4;
-        else if (prefix[i] == 'х') cp866_prefix[i] = 0xE5;
-        else if (prefix[i] == 'ц') cp866_prefix[i] = 0xE6;
-        else if (prefix[i] == 'ч') cp866_prefix[i] = 0xE7;
-        else if (prefix[i] == 'ш') cp866_prefix[i] = 0xE8;
-        else if (prefix[i] == 'щ') cp866_prefix[i] = 0xE9;
-        else if (prefix[i] == 'ъ') cp866_prefix[i] = 0xEA;
-        else if (prefix[i] == 'ы') cp866_prefix[i] = 0xEB;
-        else if (prefix[i] == 'ь') cp866_prefix[i] = 0xEC;
-        else if (prefix[i] == 'э') cp866_prefix[i] = 0xED;
-        else if (prefix[i] == 'ю') cp866_prefix[i] = 0xEE;
-        else if (prefix[i] == 'я') cp866_prefix[i] = 0xEF;
-        else cp866_prefix[i] = prefix[i];
+#if defined(__AVX2__)
+    const __m256i offsets = _mm256_setr_epi32(0, 1 * sizeof(Record), 2 * sizeof(Record),
+                                              3 * sizeof(Record), 4 * sizeof(Record),
+                                              5 * sizeof(Record), 6 * sizeof(Record),
+                                              7 * sizeof(Record));
+    const __m256i vkey = _mm256_set1_epi32((int)key);
+    const __m256i vmask = _mm256_set1_epi32((int)mask);
+    for (; i + 8 <= count; i += 8) {
+        __m256i heads = _mm256_i32gather_epi32((const int*)records[i].street, offsets, 1);
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_and_si256(heads, vmask), vkey);
+        int bits = _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        while (bits) {
+            int lane = lowest_bit((unsigned int)bits);
+            if (!push_index(out, i + lane)) return 0;
+            bits &= bits - 1;
+        }
     }
+#endif
     
-    for (int i = 0; i < count; i++) {
-        if (string_compare(records[i].street, cp866_prefix, 3) == 0) {
-            indices[found_count++] = i;
+    // Скалярный хвост (и полный проход без AVX2)
+    for (; i < count; i++) {
+        if ((street_head(records, i) & mask) == key) {
+            if (!push_index(out, i)) return 0;
         }
     }
+    return 1;
+}
+
+int search_by_street_prefix(Record* records, int count, const char* prefix, int** results) {
+    char cp866_prefix[4] = {0};
+    utf8_to_cp866(prefix, cp866_prefix, 3);
     
-    *results = malloc(found_count * sizeof(int));
-    memcpy(*results, indices, found_count * sizeof(int));
-    free(indices);
+    IndexBuffer found = {NULL, 0, 0};
+    if (!scan_street_prefix(records, count, cp866_prefix, &found)) {
+        printf("Ошибка: недостаточно памяти для результатов поиска\n");
+    }
     
-    return found_count;
+    *results = found.data;
+    return found.size;
 }
 
 void clear_input_buffer() {
@@ -281,11 +459,14 @@ void clear_input_buffer() {
 
 int main() {
     setlocale(LC_ALL, "ru_RU.UTF-8");
+    init_cp866_table();
     
     int record_count = 0;
     Record* database = load_database("database.dat", &record_count);
     Record* sorted_database = NULL;
     int is_sorted = 0;
+    DisplayCache database_text = {NULL, 0};
+    DisplayCache sorted_text = {NULL, 0};
     
     if (!database) {
         printf("Не удалось загрузить базу данных\n");
@@ -316,7 +497,7 @@ int main() {
             case 1: {
                 int sub_choice;
                 do {
-                    display_records_page(database, record_count, current_page, "ИСХОДНЫЕ ДАННЫЕ");
+                    display_records_page(&database_text, database, record_count, current_page, "ИСХОДНЫЕ ДАННЫЕ");
                     printf("\n1. Следующая страница\n");
                     printf("2. Предыдущая страница\n");
                     printf("3. В главное меню\n");
@@ -353,6 +534,7 @@ int main() {
                 memcpy(sorted_database, database, record_count * sizeof(Record));
                 
                 heap_sort(sorted_database, record_count);
+                free_display_cache(&sorted_text);
                 is_sorted = 1;
                 current_sorted_page = 0;
                 printf("Сортировка завершена!\n");
@@ -367,7 +549,7 @@ int main() {
                 
                 int sub_choice;
                 do {
-                    display_records_page(sorted_database, record_count, current_sorted_page, "ОТСОРТИРОВАННЫЕ ДАННЫЕ");
+                    display_records_page(&sorted_text, sorted_database, record_count, current_sorted_page, "ОТСОРТИРОВАННЫЕ ДАННЫЕ");
                     printf("\n1. Следующая страница\n");
                     printf("2. Предыдущая страница\n");
                     printf("3. В главное меню\n");
@@ -397,10 +579,10 @@ int main() {
             }
             
             case 4: {
-                char search_prefix[4];
+                char search_prefix[16];
                 printf("Введите первые 3 буквы улицы: ");
                 
-                if (scanf("%3s", search_prefix) != 1) {
+                if (scanf("%15s", search_prefix) != 1) {
                     clear_input_buffer();
                     printf("Неверный ввод\n");
                     break;
@@ -408,6 +590,7 @@ int main() {
                 clear_input_buffer();
                 
                 Record* search_base = is_sorted ? sorted_database : database;
+                DisplayCache* search_text = is_sorted ? &sorted_text : &database_text;
                 const char* base_type = is_sorted ? "отсортированной" : "исходной";
                 
                 printf("Поиск в %s базе...\n", base_type);
@@ -419,7 +602,7 @@ int main() {
                     printf("\nНайдено записей: %d\n", found_count);
                     for (int i = 0; i < found_count; i++) {
                         printf("Запись %d:\n", results[i] + 1);
-                        display_record(&search_base[results[i]]);
+                        display_record(search_text, search_base, record_count, results[i]);
                     }
                 } else {
                     printf("Записей с улицами, начинающимися на '%s' не найдено\n", search_prefix);
@@ -439,6 +622,8 @@ int main() {
         }
     } while (choice != 0);
     
+    free_display_cache(&database_text);
+    free_display_cache(&sorted_text);
     free(database);
     if (sorted_database) free(sorted_database);
     return 0;
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Builds the programs, generates a database of each size and times every stage.
+# Usage: ./bench.sh [records...]
+set -e
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+sizes="${*:-100000 1000000 10000000}"
+root=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+$CC $CFLAGS "$root/generator.c" -o "$work/generator" -lm
+$CC $CFLAGS "$root/courswork.c" -o "$work/courswork" -lpthread
+$CC $CFLAGS "$root/code.c" -o "$work/code" -lm
+
+cd "$work"
+for n in $sizes; do
+    echo "== $n records =="
+    ./generator "$n" database.dat --seed=1 > /dev/null
+    ./courswork --bench "$n"
+    ./code database.dat | grep -a -E "Время|Коэффициент"
+    rm -f database.dat database.dat.huff
+done
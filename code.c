@@ -1,16 +1,23 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 
 #define MAX_SYMBOLS 256
 #define MAX_CODE_LENGTH 256
 #define MAX_FILENAME 256
+#define MAX_CODE_BITS 64
+#define IO_BLOCK_SIZE (1 << 20)
 
 typedef struct {
     double probability;
+    uint64_t frequency;
     char code[MAX_CODE_LENGTH];
     int code_length;
+    uint64_t bits;  // тот же код числом, старший бит кода - первый
+    int symbol;     // байт, которому соответствует строка таблицы
 } SymbolData;
 
 // Функция Up - поиск и вставка суммы вероятностей
@@ -85,6 +92,75 @@ void Huffman(int n, double P[], SymbolData C[], int L[]) {
     }
 }
 
+// Длины кодов Хаффмана слиянием двух очередей за O(n) по целым частотам.
+// Символы 1..n отсортированы по убыванию частоты, поэтому листья берутся
+// с конца, а суммы появляются в неубывающем порядке и образуют вторую очередь.
+void huffman_code_lengths(int n, const SymbolData C[], int L[]) {
+    uint64_t weight[2 * MAX_SYMBOLS];
+    int parent[2 * MAX_SYMBOLS];
+    int depth[2 * MAX_SYMBOLS];
+    
+    for (int k = 0; k < n; k++) {
+        weight[k] = C[n - k].frequency;
+    }
+    
+    int leaf = 0;   // голова очереди листьев
+    int node = n;   // голова очереди сумм
+    for (int next = n; next < 2 * n - 1; next++) {
+        int pick[2];
+        for (int t = 0; t < 2; t++) {
+            // При равных весах берем лист: так дерево получается ниже
+            if (leaf < n && (node == next || weight[leaf] <= weight[node])) {
+                pick[t] = leaf++;
+            } else {
+                pick[t] = node++;
+            }
+        }
+        weight[next] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = next;
+        parent[pick[1]] = next;
+    }
+    
+    // Корень создан последним, поэтому родитель всегда обработан раньше
+    depth[2 * n - 2] = 0;
+    for (int k = 2 * n - 3; k >= 0; k--) {
+        depth[k] = depth[parent[k]] + 1;
+    }
+    for (int k = 0; k < n; k++) {
+        L[n - k] = depth[k];
+    }
+}
+
+// Канонические коды по длинам: коды одной длины идут подряд в порядке
+// номеров символов. Возвращает 0, если код не помещается в 64 бита
+// (для этого файл должен быть больше 10 ТБ).
+int assign_canonical_codes(int n, const int L[], SymbolData C[]) {
+    int count[MAX_CODE_BITS + 1] = {0};
+    for (int i = 1; i <= n; i++) {
+        if (L[i] < 1 || L[i] > MAX_CODE_BITS) {
+            return 0;
+        }
+        count[L[i]]++;
+    }
+    
+    uint64_t next_code[MAX_CODE_BITS + 1];
+    uint64_t code = 0;
+    for (int length = 1; length <= MAX_CODE_BITS; length++) {
+        code = (code + count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+    
+    for (int i = 1; i <= n; i++) {
+        C[i].code_length = L[i];
+        C[i].bits = next_code[L[i]]++;
+        for (int b = 0; b < L[i]; b++) {
+            C[i].code[b] = (C[i].bits >> (L[i] - 1 - b)) & 1 ? '1' : '0';
+        }
+        C[i].code[L[i]] = '\0';
+    }
+    return 1;
+}
+
 // Функция для вычисления энтропии
 double calculate_entropy(SymbolData symbols[], int count) {
     double entropy = 0.0;
@@ -105,6 +181,16 @@ double calculate_average_length(SymbolData symbols[], int count) {
     return avg_length;
 }
 
+// Порядок для qsort: по убыванию частоты, при равенстве - по коду символа
+int compare_frequency(const void* a, const void* b) {
+    const SymbolData* x = (const SymbolData*)a;
+    const SymbolData* y = (const SymbolData*)b;
+    if (x->frequency != y->frequency) {
+        return x->frequency < y->frequency ? 1 : -1;
+    }
+    return x->symbol - y->symbol;
+}
+
 // Функция для анализа файла и вычисления вероятностей символов
 int analyze_file(const char* filename, SymbolData symbols[], int* symbol_count, 
                  unsigned char symbol_map[], double P[]) {
@@ -115,9 +201,9 @@ int analyze_file(const char* filename, SymbolData symbols[], int* symbol_count,
     }
     
     // Подсчет частот символов
-    long freq[MAX_SYMBOLS] = {0};
-    unsigned char buffer[1024];
-    long total_chars = 0;
+    uint64_t freq[MAX_SYMBOLS] = {0};
+    unsigned char buffer[1 << 16];
+    uint64_t total_chars = 0;
     size_t bytes_read;
     
     while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
@@ -134,95 +220,131 @@ int analyze_file(const char* filename, SymbolData symbols[], int* symbol_count,
     for (int i = 0; i < MAX_SYMBOLS; i++) {
         if (freq[i] > 0) {
             (*symbol_count)++;
-            symbol_map[*symbol_count] = (unsigned char)i;
-            symbols[*symbol_count].probability = (double)freq[i] / total_chars;
-            symbols[*symbol_count].code_length = 0;
-            symbols[*symbol_count].code[0] = '\0';
-            P[*symbol_count] = symbols[*symbol_count].probability;
+            SymbolData* symbol = &symbols[*symbol_count];
+            symbol->frequency = freq[i];
+            symbol->probability = (double)freq[i] / total_chars;
+            symbol->code_length = 0;
+            symbol->code[0] = '\0';
+            symbol->bits = 0;
+            symbol->symbol = i;
         }
     }
     
     // Сортировка по убыванию вероятностей (индексы 1..n)
-    for (int i = 1; i <= *symbol_count - 1; i++) {
-        for (int j = i + 1; j <= *symbol_count; j++) {
-            if (P[i] < P[j]) {
-                // Меняем местами вероятности
-                double temp_p = P[i];
-                P[i] = P[j];
-                P[j] = temp_p;
-                
-                // Меняем местами символы в отображении
-                unsigned char temp_sym = symbol_map[i];
-                symbol_map[i] = symbol_map[j];
-                symbol_map[j] = temp_sym;
-                
-                // Меняем местами данные символов
-                SymbolData temp_sym_data = symbols[i];
-                symbols[i] = symbols[j];
-                symbols[j] = temp_sym_data;
-            }
-        }
+    qsort(&symbols[1], (size_t)*symbol_count, sizeof(SymbolData), compare_frequency);
+    for (int i = 1; i <= *symbol_count; i++) {
+        symbol_map[i] = (unsigned char)symbols[i].symbol;
+        P[i] = symbols[i].probability;
     }
     
     return 1;
 }
 
-// Функция для кодирования файла
+// Перевод строковых кодов (после Up/Down) в числовые; 0, если код длиннее 64 бит
+int codes_to_bits(SymbolData symbols[], int count) {
+    for (int i = 1; i <= count; i++) {
+        if (symbols[i].code_length > MAX_CODE_BITS) {
+            return 0;
+        }
+        symbols[i].bits = 0;
+        for (int b = 0; b < symbols[i].code_length; b++) {
+            symbols[i].bits = symbols[i].bits << 1 | (symbols[i].code[b] == '1');
+        }
+    }
+    return 1;
+}
+
+// Слово записывается старшим байтом вперед, как шли биты кода
+static void store_word(unsigned char* out, uint64_t word) {
+    for (int i = 0; i < 8; i++) {
+        out[i] = (unsigned char)(word >> (56 - 8 * i));
+    }
+}
+
+// Функция для кодирования файла: вход читается блоками по 1 МБ, коды
+// копятся в 64-битном регистре и целыми словами уходят в выходной буфер
 int encode_file(const char* input_filename, const char* output_filename, 
                 SymbolData symbols[], unsigned char symbol_map[], int symbol_count) {
     FILE* input_file = fopen(input_filename, "rb");
     FILE* output_file = fopen(output_filename, "wb");
+    unsigned char* input = malloc(IO_BLOCK_SIZE);
+    unsigned char* output = malloc(IO_BLOCK_SIZE);
     
-    if (!input_file || !output_file) {
+    if (!input_file || !output_file || !input || !output) {
         printf("Ошибка открытия файлов\n");
         if (input_file) fclose(input_file);
         if (output_file) fclose(output_file);
+        free(input);
+        free(output);
         return 0;
     }
     
     // Создаем таблицу для быстрого поиска кодов по символам
-    char* code_table[MAX_SYMBOLS] = {0};
+    uint64_t code_table[MAX_SYMBOLS] = {0};
     int code_length_table[MAX_SYMBOLS] = {0};
     
     for (int i = 1; i <= symbol_count; i++) {
         unsigned char symbol = symbol_map[i];
-        code_table[symbol] = symbols[i].code;
+        code_table[symbol] = symbols[i].bits;
         code_length_table[symbol] = symbols[i].code_length;
     }
     
-    // Кодирование данных
-    unsigned char buffer;
-    unsigned char output_byte = 0;
+    // Кодирование данных: в bit_buffer лежат bit_count младших бит,
+    // еще не записанных в output
+    uint64_t bit_buffer = 0;
     int bit_count = 0;
+    size_t used = 0;
+    size_t bytes_read;
+    int ok = 1;
     
-    while (fread(&buffer, 1, 1, input_file) == 1) {
-        char* code = code_table[buffer];
-        int length = code_length_table[buffer];
-        
-        for (int i = 0; i < length; i++) {
-            output_byte <<= 1;
-            if (code[i] == '1') {
-                output_byte |= 1;
+    while (ok && (bytes_read = fread(input, 1, IO_BLOCK_SIZE, input_file)) > 0) {
+        for (size_t k = 0; k < bytes_read; k++) {
+            uint64_t code = code_table[input[k]];
+            int length = code_length_table[input[k]];
+            int free_bits = 64 - bit_count;
+            
+            if (length < free_bits) {
+                bit_buffer = bit_buffer << length | code;
+                bit_count += length;
+                continue;
             }
-            bit_count++;
             
-            if (bit_count == 8) {
-                fwrite(&output_byte, 1, 1, output_file);
-                output_byte = 0;
-                bit_count = 0;
+            // Слово заполнено: старшая часть кода дописывается в него,
+            // остаток остается в регистре
+            int rest = length - free_bits;
+            uint64_t word = free_bits == 64 ? code : bit_buffer << free_bits | code >> rest;
+            store_word(output + used, word);
+            used += 8;
+            bit_buffer = rest ? code & (((uint64_t)1 << rest) - 1) : 0;
+            bit_count = rest;
+            
+            if (used + 8 > IO_BLOCK_SIZE) {
+                ok = fwrite(output, 1, used, output_file) == used;
+                used = 0;
             }
         }
     }
     
-    // Записываем оставшиеся биты
-    if (bit_count > 0) {
-        output_byte <<= (8 - bit_count);
-        fwrite(&output_byte, 1, 1, output_file);
+    // Записываем оставшиеся биты, дополняя последний байт нулями
+    while (bit_count > 0) {
+        int shift = bit_count - 8;
+        output[used++] = (unsigned char)(shift >= 0 ? bit_buffer >> shift : bit_buffer << -shift);
+        bit_count -= 8;
+    }
+    if (ok && used > 0) {
+        ok = fwrite(output, 1, used, output_file) == used;
     }
     
     fclose(input_file);
-    fclose(output_file);
-    return 1;
+    if (fclose(output_file) != 0) {
+        ok = 0;
+    }
+    free(input);
+    free(output);
+    if (!ok) {
+        printf("Ошибка записи в файл %s\n", output_filename);
+    }
+    return ok;
 }
 
 // Функция для вывода кодов на экран
@@ -267,12 +389,14 @@ void verify_codes(SymbolData symbols[], int count) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Использование: %s <файл_базы_данных>\n", argv[0]);
+    // --legacy: прежнее рекурсивное построение (Up/Down) по вероятностям
+    int legacy = argc == 3 && strcmp(argv[1], "--legacy") == 0;
+    if (argc != 2 && !legacy) {
+        printf("Использование: %s [--legacy] <файл_базы_данных>\n", argv[0]);
         return 1;
     }
     
-    const char* input_filename = argv[1];
+    const char* input_filename = argv[argc - 1];
     char output_filename[MAX_FILENAME];
     snprintf(output_filename, sizeof(output_filename), "%s.huff", input_filename);
     
@@ -291,6 +415,9 @@ int main(int argc, char* argv[]) {
         symbols[i].code[0] = '\0';
         symbols[i].code_length = 0;
         symbols[i].probability = 0.0;
+        symbols[i].frequency = 0;
+        symbols[i].bits = 0;
+        symbols[i].symbol = 0;
         L[i] = 0;
         P[i] = 0.0;
     }
@@ -313,13 +440,29 @@ int main(int argc, char* argv[]) {
         P_work[i] = P[i];
     }
     
-    // Построение кодов Хаффмана (точно по псевдокоду)
-    Huffman(symbol_count, P_work, symbols, L);
-    
-    // Обновление длин кодов в структуре symbols
-    for (int i = 1; i <= symbol_count; i++) {
-        symbols[i].code_length = L[i];
+    clock_t build_start = clock();
+    if (legacy) {
+        // Построение кодов Хаффмана (точно по псевдокоду)
+        Huffman(symbol_count, P_work, symbols, L);
+        
+        // Обновление длин кодов в структуре symbols
+        for (int i = 1; i <= symbol_count; i++) {
+            symbols[i].code_length = L[i];
+        }
+        if (!codes_to_bits(symbols, symbol_count)) {
+            printf("Ошибка: длина кода превышает %d бит\n", MAX_CODE_BITS);
+            return 1;
+        }
+    } else {
+        huffman_code_lengths(symbol_count, symbols, L);
+        if (!assign_canonical_codes(symbol_count, L, symbols)) {
+            printf("Ошибка: длина кода превышает %d бит\n", MAX_CODE_BITS);
+            return 1;
+        }
     }
+    double build_ms = (double)(clock() - build_start) * 1000.0 / CLOCKS_PER_SEC;
+    printf("Построение кодов: %s\n", legacy ? "рекурсивное (Up/Down)"
+                                              : "слияние двух очередей, канонические коды");
     
     // Проверка корректности кодов
     verify_codes(symbols, symbol_count);
@@ -345,7 +488,10 @@ int main(int argc, char* argv[]) {
     
     // Кодирование файла
     printf("\nКодирование файла...\n");
-    if (encode_file(input_filename, output_filename, symbols, symbol_map, symbol_count)) {
+    clock_t encode_start = clock();
+    int encoded = encode_file(input_filename, output_filename, symbols, symbol_map, symbol_count);
+    double encode_ms = (double)(clock() - encode_start) * 1000.0 / CLOCKS_PER_SEC;
+    if (encoded) {
         // Вычисление коэффициента сжатия
         FILE* input_file = fopen(input_filename, "rb");
         FILE* output_file = fopen(output_filename, "rb");
@@ -366,6 +512,9 @@ int main(int argc, char* argv[]) {
             printf("Размер исходного файла: %ld байт\n", input_size);
             printf("Размер сжатого файла: %ld байт\n", output_size);
             printf("Коэффициент сжатия: %.2f:1\n", compression_ratio);
+            printf("Время построения кодов: %.3f мс\n", build_ms);
+            printf("Время кодирования: %.1f мс (%.1f МБ/с)\n", encode_ms,
+                   encode_ms > 0 ? input_size / 1048576.0 / (encode_ms / 1000.0) : 0.0);
         }
     } else {
         printf("Ошибка при кодировании файла\n");
@@ -1,13 +1,47 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
 #include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
-#define N 4000
 #define MAX_STR_SIZE 32
 #define STREET_SIZE 18
 #define DATE_SIZE 10
+#define MAX_THREADS 64
+#define FROZEN_BFS_MAX_HEIGHT 16
+#define ACCESS_WEIGHT_CAP 65535
+#define REBUILD_MIN_LOOKUPS 16
+#define EXACT_TREE_MAX_KEYS 2000
+#define DATABASE_FILE "database.dat"
+#define INDEX_FILE "database.idx"
+#define INDEX_MAGIC "CWIX"
+#define INDEX_VERSION 2
+#define BATCH_CACHE_SIZE 64
+#define BATCH_BUFFER_SIZE (1 << 20)
+#define EXPORT_BUFFER_SIZE (1 << 20)
+#define EXPORT_ROW_MAX 1024
+#define DISPLAY_ROW_MAX 256
+#define DISPLAY_ARENA_MAX (64u << 20)
+#define PAGE_BUFFER_SIZE 8192
+#define CLEAR_SCREEN "\033[H\033[2J"
+
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p) ((void)0)
+#endif
 
 typedef struct {
     char fio[MAX_STR_SIZE];
@@ -17,68 +51,482 @@ typedef struct {
     char date[DATE_SIZE];
 } Record;
 
-typedef struct Node {
-    Record record;
-    struct Node *next;
-} Node;
-
-typedef struct QueueNode {
-    Record *record;
-    struct QueueNode *next;
-} QueueNode;
+typedef struct {
+    Record *records;
+    int count;
+    size_t size;
+    int64_t mtime;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} Database;
 
 typedef struct {
-    QueueNode *head;
-    QueueNode *tail;
+    Record **items;
+    int capacity;
+    int head;
+    int tail;
     int size;
 } Queue;
 
+typedef struct {
+    uint64_t street_hi;
+    uint64_t street_lo;
+    uint32_t tail;
+    uint32_t id;
+} SortKey;
+
+typedef struct {
+    const uint32_t *ids;
+    SortKey *keys;
+    SortKey *buffer;
+    int *bounds;
+    int runs;
+    int threads;
+    int failed;
+} ParallelSort;
+
+typedef struct {
+    void (*task)(int thread, void *arg);
+    void *arg;
+    int thread;
+} Worker;
+
+typedef struct {
+    uint32_t key;
+    int first;
+    int last;
+} PrefixEntry;
+
+typedef struct {
+    PrefixEntry *entries;
+    uint32_t mask;
+    int size;
+} PrefixDirectory;
+
+typedef struct {
+    uint32_t *first;
+    uint32_t *last;
+} RecordSpan;
+
 typedef struct TreeNode {
     Record *record;
     struct TreeNode *left;
     struct TreeNode *right;
+    struct TreeNode *parent;
 } TreeNode;
 
 typedef struct {
     Record *record;
+    int32_t date;
     int weight;
 } WeightedRecord;
 
-Record *index_database[N];
-Queue *search_queue = NULL;
+typedef struct {
+    int32_t date;
+    int32_t rank;
+    int32_t child[2];
+} FrozenNode;
+
+typedef struct {
+    FrozenNode *nodes;
+    Record **records;
+    int32_t *dates;
+    int size;
+    int height;
+    int veb;
+} FrozenTree;
+
+typedef enum {
+    SORT_HEAP,
+    SORT_RADIX
+} SortMethod;
+
+typedef enum {
+    TREE_A2,
+    TREE_EXACT
+} TreeMethod;
+
+typedef struct {
+    TreeMethod method;
+    int keys;
+    int64_t weight;
+    int64_t cost;
+    double seconds;
+} TreeBuildStats;
+
+typedef struct {
+    Queue *queue;
+    TreeNode *root;
+    FrozenTree *frozen;
+    TreeBuildStats stats;
+    int lookups_since_build;
+    int64_t accesses_at_build;
+} DateTree;
+
+typedef void (*RecordVisitor)(Record *record, void *context);
+
+// database.idx: this header, then the sorted ids, the date column and the
+// prefix directory table, all in native byte order.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t data_size;
+    int64_t data_mtime;
+    uint64_t checksum;
+    uint64_t index_checksum;
+    int32_t count;
+    uint32_t directory_capacity;
+} IndexHeader;
+
+Database database;
+PrefixDirectory prefix_directory = {NULL, 0, 0};
+int32_t *date_column = NULL;
+uint32_t *access_counts = NULL;
+SortMethod sort_method = SORT_HEAP;
+int sort_threads = 1;
+int freeze_trees = 0;
+TreeMethod tree_method = TREE_A2;
+uint32_t *index_database = NULL;
+int record_count = 0;
+int record_capacity = 0;
+int database_changed = 0;
+
+// UTF-8 rows for print_record, transcoded the first time a record is shown.
+// Rows live in one arena; a length of 0 means the row is not rendered yet.
+char *display_arena = NULL;
+uint32_t display_arena_size = 0;
+uint32_t display_arena_capacity = 0;
+uint32_t *display_offset = NULL;
+uint16_t *display_length = NULL;
+int display_slots = 0;
+
+double now_seconds() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif
+}
+
+// Built with -DINSTRUMENT, the hot paths count their work and time each
+// operation into log-linear latency histograms. Otherwise every STAT_* and
+// LATENCY_* macro expands to nothing.
+#ifdef INSTRUMENT
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Values below 2^(SUB_BITS + 1) ns get a bucket each; above that every
+// power of two is split into 2^SUB_BITS buckets, about 12% wide.
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+typedef struct {
+    uint64_t heap_compares;
+    uint64_t heap_moves;
+    uint64_t search_probes;
+    uint64_t directory_probes;
+    uint64_t queue_allocations;
+    uint64_t a2_builds;
+    uint64_t a2_max_depth;
+    uint64_t tree_searches;
+    uint64_t tree_search_steps;
+    uint64_t tree_search_max_depth;
+} StatCounters;
+
+typedef enum {
+    OP_LOAD,
+    OP_SORT,
+    OP_PREFIX,
+    OP_DATE,
+    OP_RANGE,
+    OP_TREE_BUILD,
+    OP_COUNT
+} Operation;
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+} Histogram;
+
+const char *operation_names[OP_COUNT] = {
+    "load", "sort", "prefix_query", "date_query", "range_query", "tree_build"
+};
+
+// Sort workers count into their own copy and merge it when they finish.
+THREAD_LOCAL StatCounters stat_local;
+StatCounters stat_totals;
+Histogram latency[OP_COUNT];
+const char *stats_file = "instrument.json";
+
+void atomic_add(uint64_t *target, uint64_t value) {
+#if defined(__GNUC__)
+    __atomic_fetch_add(target, value, __ATOMIC_RELAXED);
+#else
+    InterlockedExchangeAdd64((volatile LONG64*)target, (LONG64)value);
+#endif
+}
+
+void atomic_max(uint64_t *target, uint64_t value) {
+#if defined(__GNUC__)
+    uint64_t seen = __atomic_load_n(target, __ATOMIC_RELAXED);
+    while (seen < value &&
+           !__atomic_compare_exchange_n(target, &seen, value, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+#else
+    LONG64 seen = *(volatile LONG64*)target;
+    while ((uint64_t)seen < value) {
+        LONG64 previous = InterlockedCompareExchange64((volatile LONG64*)target, (LONG64)value, seen);
+        if (previous == seen) break;
+        seen = previous;
+    }
+#endif
+}
+
+void stat_flush() {
+    atomic_add(&stat_totals.heap_compares, stat_local.heap_compares);
+    atomic_add(&stat_totals.heap_moves, stat_local.heap_moves);
+    atomic_add(&stat_totals.search_probes, stat_local.search_probes);
+    atomic_add(&stat_totals.directory_probes, stat_local.directory_probes);
+    atomic_add(&stat_totals.queue_allocations, stat_local.queue_allocations);
+    atomic_add(&stat_totals.a2_builds, stat_local.a2_builds);
+    atomic_max(&stat_totals.a2_max_depth, stat_local.a2_max_depth);
+    atomic_add(&stat_totals.tree_searches, stat_local.tree_searches);
+    atomic_add(&stat_totals.tree_search_steps, stat_local.tree_search_steps);
+    atomic_max(&stat_totals.tree_search_max_depth, stat_local.tree_search_max_depth);
+    memset(&stat_local, 0, sizeof(stat_local));
+}
+
+int histogram_bucket(uint64_t ns) {
+    if (ns < (2u << HISTOGRAM_SUB_BITS)) {
+        return (int)ns;
+    }
+    int exponent = 0;
+    for (uint64_t v = ns; v > 1; v >>= 1) {
+        exponent++;
+    }
+    int shift = exponent - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + (int)((ns >> shift) & ((1u << HISTOGRAM_SUB_BITS) - 1));
+}
+
+uint64_t histogram_floor(int bucket) {
+    if (bucket < (2 << HISTOGRAM_SUB_BITS)) {
+        return (uint64_t)bucket;
+    }
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (uint64_t)(bucket & ((1 << HISTOGRAM_SUB_BITS) - 1));
+    return ((1ULL << HISTOGRAM_SUB_BITS) + sub) << shift;
+}
+
+void record_latency(Operation op, double seconds) {
+    Histogram *h = &latency[op];
+    uint64_t ns = seconds > 0 ? (uint64_t)(seconds * 1e9) : 0;
+    h->counts[histogram_bucket(ns)]++;
+    if (h->count == 0 || ns < h->min_ns) h->min_ns = ns;
+    if (ns > h->max_ns) h->max_ns = ns;
+    h->count++;
+    h->total_ns += ns;
+}
+
+uint64_t histogram_percentile(const Histogram *h, double fraction) {
+    uint64_t rank = (uint64_t)(fraction * (double)h->count);
+    uint64_t seen = 0;
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen > rank) {
+            return histogram_floor(b);
+        }
+    }
+    return h->max_ns;
+}
+
+// Percentiles are bucket floors, so they read up to one bucket low.
+void write_stats_json(FILE *out) {
+    stat_flush();
+    const StatCounters *c = &stat_totals;
+    fprintf(out, "{\n  \"counters\": {\n");
+    fprintf(out, "    \"heap_compares\": %llu,\n", (unsigned long long)c->heap_compares);
+    fprintf(out, "    \"heap_moves\": %llu,\n", (unsigned long long)c->heap_moves);
+    fprintf(out, "    \"search_probes\": %llu,\n", (unsigned long long)c->search_probes);
+    fprintf(out, "    \"directory_probes\": %llu,\n", (unsigned long long)c->directory_probes);
+    fprintf(out, "    \"queue_allocations\": %llu,\n", (unsigned long long)c->queue_allocations);
+    fprintf(out, "    \"a2_builds\": %llu,\n", (unsigned long long)c->a2_builds);
+    fprintf(out, "    \"a2_max_depth\": %llu,\n", (unsigned long long)c->a2_max_depth);
+    fprintf(out, "    \"tree_searches\": %llu,\n", (unsigned long long)c->tree_searches);
+    fprintf(out, "    \"tree_search_steps\": %llu,\n", (unsigned long long)c->tree_search_steps);
+    fprintf(out, "    \"tree_search_max_depth\": %llu\n", (unsigned long long)c->tree_search_max_depth);
+    fprintf(out, "  },\n  \"latency_ns\": {\n");
+    for (int op = 0; op < OP_COUNT; op++) {
+        const Histogram *h = &latency[op];
+        fprintf(out, "    \"%s\": {\"count\": %llu, \"mean\": %.1f, \"min\": %llu, \"p50\": %llu, "
+                "\"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"buckets\": [",
+                operation_names[op], (unsigned long long)h->count,
+                h->count > 0 ? (double)h->total_ns / (double)h->count : 0.0, (unsigned long long)h->min_ns,
+                (unsigned long long)histogram_percentile(h, 0.5),
+                (unsigned long long)histogram_percentile(h, 0.9),
+                (unsigned long long)histogram_percentile(h, 0.99),
+                (unsigned long long)histogram_percentile(h, 0.999), (unsigned long long)h->max_ns);
+        const char *separator = "";
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            if (h->counts[b] != 0) {
+                fprintf(out, "%s[%llu, %llu]", separator, (unsigned long long)histogram_floor(b),
+                        (unsigned long long)h->counts[b]);
+                separator = ", ";
+            }
+        }
+        fprintf(out, "]}%s\n", op + 1 < OP_COUNT ? "," : "");
+    }
+    fprintf(out, "  }\n}\n");
+}
+
+int save_stats(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    write_stats_json(file);
+    return fclose(file) == 0;
+}
+
+#define STAT_ADD(counter, n) (stat_local.counter += (uint64_t)(n))
+#define STAT_MAX(counter, value) \
+    do { if ((uint64_t)(value) > stat_local.counter) stat_local.counter = (uint64_t)(value); } while (0)
+#define STAT_FLUSH() stat_flush()
+#define LATENCY_START(start) double start = now_seconds()
+#define LATENCY_END(op, start) record_latency(op, now_seconds() - (start))
+#else
+#define STAT_ADD(counter, n) ((void)0)
+#define STAT_MAX(counter, value) ((void)0)
+#define STAT_FLUSH() ((void)0)
+#define LATENCY_START(start) ((void)0)
+#define LATENCY_END(op, start) ((void)0)
+#endif
+
+char* read_answer() {
+    static char ans[100];
+    scanf("%99s", ans);
+    return ans;
+}
 
 char* prompt(const char *str) {
+    printf("%s\n> ", str);
+    return read_answer();
+}
+
+// Like prompt, but keeps spaces so a full name fits in one answer.
+char* prompt_line(const char *str) {
     printf("%s\n> ", str);
     static char ans[100];
-    scanf("%s", ans);
+    scanf(" %99[^\n]", ans);
     return ans;
 }
 
-Node* load_to_memory() {
-    FILE *file = fopen("database.dat", "rb");
-    if (!file) {
-        return NULL;
+int map_database(Database *db, const char *filename) {
+    memset(db, 0, sizeof(Database));
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
     }
 
-    Node *root = NULL;
-    for (int i = 0; i < N; ++i) {
-        Record record;
-        fread(&record, sizeof(Record), 1, file);
-        Node *new_node = (Node*)malloc(sizeof(Node));
-        new_node->record = record;
-        new_node->next = root;
-        root = new_node;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 ||
+        size.QuadPart % sizeof(Record) != 0 ||
+        (uint64_t)size.QuadPart / sizeof(Record) > INT32_MAX) {
+        CloseHandle(file);
+        return -1;
     }
-    fclose(file);
-    return root;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return 0;
+    }
+
+    FILETIME written;
+    if (GetFileTime(file, NULL, NULL, &written)) {
+        db->mtime = ((int64_t)written.dwHighDateTime << 32) | written.dwLowDateTime;
+    }
+
+    db->file = file;
+    db->mapping = mapping;
+    db->size = (size_t)size.QuadPart;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || st.st_size % sizeof(Record) != 0 ||
+        (uint64_t)st.st_size / sizeof(Record) > INT32_MAX) {
+        close(fd);
+        return -1;
+    }
+
+    void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        return 0;
+    }
+
+    db->size = (size_t)st.st_size;
+    // Nanoseconds, so a same-size rewrite within one second still shows up
+#if defined(__APPLE__)
+    db->mtime = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+    db->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+#endif
+    db->records = (Record*)view;
+    db->count = (int)(db->size / sizeof(Record));
+    return 1;
 }
 
-void make_index_array(Record *arr[], Node *root, int n) {
-    Node *p = root;
+void unmap_database(Database *db) {
+    if (db->records == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(db->records);
+    CloseHandle(db->mapping);
+    CloseHandle(db->file);
+#else
+    munmap(db->records, db->size);
+#endif
+    db->records = NULL;
+    db->count = 0;
+}
+
+Record* record_at(uint32_t id) {
+    return &database.records[id];
+}
+
+uint32_t* make_index_array(int n) {
+    uint32_t *arr = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+    if (arr == NULL) {
+        return NULL;
+    }
     for (int i = 0; i < n; i++) {
-        arr[i] = &(p->record);
-        p = p->next;
+        arr[i] = (uint32_t)i;
     }
+    return arr;
 }
 
 int compare_records(const Record *record1, const Record *record2) {
@@ -89,14 +537,38 @@ int compare_records(const Record *record1, const Record *record2) {
     return record1->home - record2->home;
 }
 
-int compare_for_heap(const void *a, const void *b) {
-    Record *r1 = *(Record**)a;
-    Record *r2 = *(Record**)b;
-    return compare_records(r1, r2);
+// Packs street and home into integers that compare like compare_records:
+// street bytes big-endian (zeroed after the terminator, as strcmp stops
+// there), then the 17th byte and home with the sign bit flipped. Equal keys
+// are ordered by record id, so every sort yields the same stable order.
+void make_sort_key(SortKey *key, uint32_t id) {
+    const Record *record = record_at(id);
+    unsigned char bytes[STREET_SIZE] = {0};
+    for (int i = 0; i < STREET_SIZE - 1 && record->street[i] != '\0'; i++) {
+        bytes[i] = (unsigned char)record->street[i];
+    }
+
+    uint64_t hi = 0, lo = 0;
+    for (int i = 0; i < 8; i++) {
+        hi = (hi << 8) | bytes[i];
+        lo = (lo << 8) | bytes[i + 8];
+    }
+    key->street_hi = hi;
+    key->street_lo = lo;
+    key->tail = ((uint32_t)bytes[16] << 16) | (uint16_t)(record->home ^ 0x8000);
+    key->id = id;
+}
+
+int compare_keys(const SortKey *a, const SortKey *b) {
+    if (a->street_hi != b->street_hi) return a->street_hi < b->street_hi ? -1 : 1;
+    if (a->street_lo != b->street_lo) return a->street_lo < b->street_lo ? -1 : 1;
+    if (a->tail != b->tail) return a->tail < b->tail ? -1 : 1;
+    if (a->id != b->id) return a->id < b->id ? -1 : 1;
+    return 0;
 }
 
-void heapify(Record *array[], int L, int R) {
-    Record *x = array[L];
+void heapify(SortKey array[], int L, int R) {
+    SortKey x = array[L];
     int i = L;
     
     while (1) {
@@ -104,20 +576,23 @@ void heapify(Record *array[], int L, int R) {
         
         if (j > R) break;
         
-        if (j < R && compare_for_heap(&array[j + 1], &array[j]) > 0) {
+        STAT_ADD(heap_compares, 1 + (j < R));
+        if (j < R && compare_keys(&array[j + 1], &array[j]) > 0) {
             j = j + 1;
         }
         
-        if (compare_for_heap(&x, &array[j]) > 0) break;
+        if (compare_keys(&x, &array[j]) > 0) break;
         
         array[i] = array[j];
+        STAT_ADD(heap_moves, 1);
         i = j;
     }
     
     array[i] = x;
+    STAT_ADD(heap_moves, 2);
 }
 
-void HeapSort(Record *array[], int n) {
+void HeapSort(SortKey array[], int n) {
     int L = n / 2 - 1;
     
     while (L >= 0) {
@@ -128,9 +603,10 @@ void HeapSort(Record *array[], int n) {
     int R = n - 1;
     
     while (R > 0) {
-        Record *temp = array[0];
+        SortKey temp = array[0];
         array[0] = array[R];
         array[R] = temp;
+        STAT_ADD(heap_moves, 3);
         
         R = R - 1;
         
@@ -138,528 +614,2454 @@ void HeapSort(Record *array[], int n) {
             heapify(array, 0, R);
         }
     }
+    STAT_FLUSH();
 }
 
-void print_head() {
-    printf("Record Full Name                        Street          Home  Apt  Date\n");
-}
+#define KEY_BYTES 19
 
-void print_record(Record *record, int i) {
-    printf("[%4d] %-32s  %-15s  %-4d  %-3d  %s\n", 
-           i, record->fio, record->street, record->home, 
-           record->appartament, record->date);
+unsigned char key_byte(const SortKey *key, int b) {
+    if (b < 3) return (unsigned char)(key->tail >> (8 * b));
+    if (b < 11) return (unsigned char)(key->street_lo >> (8 * (b - 3)));
+    return (unsigned char)(key->street_hi >> (8 * (b - 11)));
 }
 
-void show_list(Record *ind_arr[], int n) {
-    int ind = 0;
-    while (1) {
-        system("cls");
-        print_head();
-        for (int i = 0; i < 20 && (ind + i) < n; i++) {
-            print_record(ind_arr[ind + i], ind + i + 1);
+int RadixSort(SortKey array[], int n) {
+    SortKey *buffer = (SortKey*)malloc((size_t)n * sizeof(SortKey));
+    size_t (*count)[256] = calloc(KEY_BYTES, sizeof(*count));
+    if (buffer == NULL || count == NULL) {
+        free(buffer);
+        free(count);
+        return 0;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        for (int b = 0; b < KEY_BYTES; b++) {
+            count[b][key_byte(&array[i], b)]++;
+        }
+    }
+    
+    SortKey *from = array, *to = buffer;
+    for (int b = 0; b < KEY_BYTES; b++) {
+        if (count[b][key_byte(&from[0], b)] == (size_t)n) {
+            continue;
         }
         
-        printf("\nPage %d/%d\n", (ind / 20) + 1, (n / 20) + 1);
-        char *chose = prompt("w: Next page\tq: Last page\te: Skip 10 next pages\n"
-                             "s: Prev page\ta: First page\td: Skip 10 prev pages\n"
-                             "Any key: Exit");
-        
-        switch (chose[0]) {
-            case 'w': ind += 20; break;
-            case 's': ind -= 20; break;
-            case 'a': ind = 0; break;
-            case 'q': ind = n - 20; break;
-            case 'd': ind -= 200; break;
-            case 'e': ind += 200; break;
-            default: return;
+        size_t offset = 0;
+        for (int v = 0; v < 256; v++) {
+            size_t c = count[b][v];
+            count[b][v] = offset;
+            offset += c;
+        }
+        for (int i = 0; i < n; i++) {
+            to[count[b][key_byte(&from[i], b)]++] = from[i];
         }
         
-        if (ind < 0) ind = 0;
-        if (ind > n - 20) ind = n - 20;
+        SortKey *temp = from;
+        from = to;
+        to = temp;
     }
+    
+    if (from != array) {
+        memcpy(array, from, (size_t)n * sizeof(SortKey));
+    }
+    free(buffer);
+    free(count);
+    return 1;
 }
 
-int compare_search(const char *street, const char *key) {
-    return strncmp(street, key, 3);
+#ifdef _WIN32
+DWORD WINAPI worker_main(LPVOID arg) {
+    Worker *worker = (Worker*)arg;
+    worker->task(worker->thread, worker->arg);
+    return 0;
+}
+#else
+void* worker_main(void *arg) {
+    Worker *worker = (Worker*)arg;
+    worker->task(worker->thread, worker->arg);
+    return NULL;
 }
+#endif
 
-int binary_search(Record *arr[], const char *key, int *first_index) {
-    int left = 0;
-    int right = N - 1;
-    
-    while (left < right) {
-        int mid = left + (right - left) / 2;
-        int cmp = compare_search(arr[mid]->street, key);
-        
-        if (cmp < 0) {
-            left = mid + 1;
-        } else {
-            right = mid;
+void run_parallel(int threads, void (*task)(int thread, void *arg), void *arg) {
+    Worker workers[MAX_THREADS];
+    int started[MAX_THREADS] = {0};
+#ifdef _WIN32
+    HANDLE handles[MAX_THREADS];
+#else
+    pthread_t handles[MAX_THREADS];
+#endif
+
+    for (int t = 1; t < threads; t++) {
+        workers[t].task = task;
+        workers[t].arg = arg;
+        workers[t].thread = t;
+#ifdef _WIN32
+        handles[t] = CreateThread(NULL, 0, worker_main, &workers[t], 0, NULL);
+        started[t] = handles[t] != NULL;
+#else
+        started[t] = pthread_create(&handles[t], NULL, worker_main, &workers[t]) == 0;
+#endif
+        if (!started[t]) {
+            task(t, arg);
         }
     }
-    
-    if (compare_search(arr[left]->street, key) == 0) {
-        *first_index = left;
-        return 1;
-    } else {
-        return 0;
+    task(0, arg);
+
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+#ifdef _WIN32
+            WaitForSingleObject(handles[t], INFINITE);
+            CloseHandle(handles[t]);
+#else
+            pthread_join(handles[t], NULL);
+#endif
+        }
     }
 }
 
-Queue* create_queue() {
-    Queue *q = (Queue*)malloc(sizeof(Queue));
-    q->head = q->tail = NULL;
-    q->size = 0;
-    return q;
-}
+void sort_chunk_task(int thread, void *arg) {
+    ParallelSort *ps = (ParallelSort*)arg;
+    int lo = ps->bounds[thread];
+    int hi = ps->bounds[thread + 1];
 
-void enqueue(Queue *q, Record *record) { 
-    QueueNode *new_node = (QueueNode*)malloc(sizeof(QueueNode));
-    new_node->record = record;
-    new_node->next = NULL;
-    
-    if (q->tail == NULL) {
-        q->head = q->tail = new_node;
+    for (int i = lo; i < hi; i++) {
+        make_sort_key(&ps->keys[i], ps->ids[i]);
+    }
+    if (sort_method == SORT_RADIX) {
+        if (hi > lo && !RadixSort(ps->keys + lo, hi - lo)) {
+            ps->failed = 1;
+        }
     } else {
-        q->tail->next = new_node;
-        q->tail = new_node;
+        HeapSort(ps->keys + lo, hi - lo);
     }
-    q->size++;
 }
 
-Record* dequeue(Queue *q) {
-    if (q->head == NULL) {
-        return NULL;
-    }
-    
-    QueueNode *temp = q->head;
-    Record *record = temp->record;
-    
-    q->head = q->head->next;
-    if (q->head == NULL) {
-        q->tail = NULL;
+// Number of elements taken from a in the first d elements of merge(a, b).
+int merge_path(const SortKey *a, int m, const SortKey *b, int n, int d) {
+    int lo = d > n ? d - n : 0;
+    int hi = d < m ? d : m;
+    while (lo < hi) {
+        int i = lo + (hi - lo) / 2;
+        if (compare_keys(&a[i], &b[d - i - 1]) < 0) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
     }
-    
-    free(temp);
-    q->size--;
-    return record;
+    return lo;
 }
 
-int is_queue_empty(Queue *q) {
-    return q->head == NULL;
-}
+// Every pair of runs is cut into equal output slices, one per thread, so
+// all threads stay busy even in the last rounds where only one pair is left.
+void merge_runs_task(int thread, void *arg) {
+    ParallelSort *ps = (ParallelSort*)arg;
 
-void free_queue(Queue *q) {
-    while (!is_queue_empty(q)) {
-        dequeue(q);
+    for (int r = 0; r < ps->runs; r += 2) {
+        int lo = ps->bounds[r];
+        int mid = ps->bounds[r + 1];
+        int hi = r + 2 <= ps->runs ? ps->bounds[r + 2] : mid;
+        const SortKey *a = ps->keys + lo;
+        const SortKey *b = ps->keys + mid;
+        int m = mid - lo, n = hi - mid;
+
+        int d0 = (int)((int64_t)(m + n) * thread / ps->threads);
+        int d1 = (int)((int64_t)(m + n) * (thread + 1) / ps->threads);
+        int i = merge_path(a, m, b, n, d0);
+        int j = d0 - i;
+        SortKey *out = ps->buffer + lo + d0;
+
+        for (int d = d0; d < d1; d++) {
+            if (j >= n || (i < m && compare_keys(&a[i], &b[j]) < 0)) {
+                *out++ = a[i++];
+            } else {
+                *out++ = b[j++];
+            }
+        }
     }
-    free(q);
 }
 
-void add_to_queue(Record *record) {
-    if (search_queue == NULL) {
-        search_queue = create_queue();
+int parallel_sort_keys(const uint32_t ids[], SortKey keys[], int n, int threads) {
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+    if (threads > n) threads = n > 0 ? n : 1;
+
+    ParallelSort ps;
+    ps.ids = ids;
+    ps.keys = keys;
+    ps.buffer = (SortKey*)malloc((size_t)n * sizeof(SortKey));
+    ps.bounds = (int*)malloc((threads + 1) * sizeof(int));
+    ps.runs = threads;
+    ps.threads = threads;
+    ps.failed = 0;
+    if (ps.buffer == NULL || ps.bounds == NULL) {
+        free(ps.buffer);
+        free(ps.bounds);
+        return 0;
     }
-    enqueue(search_queue, record);
-}
 
-void print_queue() {
-    if (search_queue == NULL || is_queue_empty(search_queue)) {
-        printf("Queue is empty\n");
-        return;
+    for (int t = 0; t <= threads; t++) {
+        ps.bounds[t] = (int)((int64_t)n * t / threads);
     }
-    
-    printf("\n=== FOUND RECORDS QUEUE ===\n");
-    printf("Queue size: %d\n", search_queue->size);
-    printf("Head: %s, Tail: %s\n", 
-           search_queue->head->record->street, 
-           search_queue->tail->record->street);
-    print_head();
-    
-    QueueNode *current = search_queue->head;
-    int i = 1;
-    while (current != NULL) {
-        print_record(current->record, i++);
-        current = current->next;
+    run_parallel(threads, sort_chunk_task, &ps);
+
+    while (ps.runs > 1 && !ps.failed) {
+        run_parallel(threads, merge_runs_task, &ps);
+
+        SortKey *temp = ps.keys;
+        ps.keys = ps.buffer;
+        ps.buffer = temp;
+
+        int runs = 0;
+        for (int r = 0; r < ps.runs; r += 2) {
+            ps.bounds[runs++] = ps.bounds[r];
+        }
+        ps.bounds[runs] = n;
+        ps.runs = runs;
+    }
+
+    if (ps.keys != keys) {
+        memcpy(keys, ps.keys, (size_t)n * sizeof(SortKey));
+        ps.buffer = ps.keys;
     }
+    free(ps.buffer);
+    free(ps.bounds);
+    return !ps.failed;
 }
 
-void search_database() {
-    char search_key[4] = {0};
-    int first_index;
-    int found_count = 0;
+int sort_index(uint32_t ids[], int n) {
+    SortKey *keys = (SortKey*)malloc((size_t)n * sizeof(SortKey));
+    if (keys == NULL) {
+        return 0;
+    }
     
-    do {
-        system("cls");
-        printf("\n=== BINARY SEARCH IN DATABASE ===\n");
-        printf("Search by first 3 letters of street name\n\n");
-        
-        char *input = prompt("Enter first 3 letters of street name (or 'q' to quit)");
-        
-        if (input[0] == 'q' || input[0] == 'Q') {
-            return;
-        }
-        
-        if (strlen(input) < 3) {
-            printf("Error: Please enter at least 3 characters\n");
-            printf("Press any key to continue...");
-            getchar();
-            continue;
+    if (sort_threads > 1) {
+        if (!parallel_sort_keys(ids, keys, n, sort_threads)) {
+            free(keys);
+            return 0;
         }
-        
-        strncpy(search_key, input, 3);
-        search_key[3] = '\0';
-        
-        if (search_queue != NULL) {
-            free_queue(search_queue);
-            search_queue = NULL;
+    } else {
+        for (int i = 0; i < n; i++) {
+            make_sort_key(&keys[i], ids[i]);
         }
-        
-        int search_result = binary_search(index_database, search_key, &first_index);
-        
-        if (!search_result) {
-            printf("No records found for street starting with '%s'\n", search_key);
-        } else {
-            found_count = 0;
-            for (int i = first_index; i < N; i++) {
-                if (compare_search(index_database[i]->street, search_key) == 0) {
-                    add_to_queue(index_database[i]);
-                    found_count++;
-                } else {
-                    break;
-                }
+        if (sort_method == SORT_RADIX) {
+            if (!RadixSort(keys, n)) {
+                free(keys);
+                return 0;
             }
-            
-            printf("Found %d records for street starting with '%s'\n", found_count, search_key);
-            printf("First occurrence at index: %d\n", first_index + 1);
-            
-            print_queue();
-        }
-        
-        char *again = prompt("\nSearch again? (y/n)");
-        if (again[0] != 'y' && again[0] != 'Y') {
-            break;
+        } else {
+            HeapSort(keys, n);
         }
-        
-    } while (1);
+    }
     
-    if (search_queue != NULL) {
-        free_queue(search_queue);
-        search_queue = NULL;
+    for (int i = 0; i < n; i++) {
+        ids[i] = keys[i].id;
     }
+    free(keys);
+    return 1;
 }
 
-void show_record_by_number(Record *arr[]) {
-    char *input = prompt("Enter record number (1-4000) or 'q' to quit");
-    
-    if (input[0] == 'q' || input[0] == 'Q') {
-        return;
+// CP866 0x80-0xFF as Unicode code points; the lower half is ASCII.
+static const uint16_t cp866_upper[128] = {
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,
+    0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040E, 0x045E,
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x2116, 0x00A4, 0x25A0, 0x00A0
+};
+
+typedef struct {
+    char bytes[3];
+    uint8_t length;
+} Utf8Char;
+
+// Every CP866 byte already encoded as UTF-8; filled in once by main.
+Utf8Char utf8_table[256];
+
+void init_utf8_table() {
+    for (int c = 0; c < 256; c++) {
+        Utf8Char *entry = &utf8_table[c];
+        uint16_t code = c < 0x80 ? (uint16_t)c : cp866_upper[c - 0x80];
+        if (code < 0x80) {
+            entry->bytes[0] = (char)code;
+            entry->length = 1;
+        } else if (code < 0x800) {
+            entry->bytes[0] = (char)(0xC0 | code >> 6);
+            entry->bytes[1] = (char)(0x80 | (code & 0x3F));
+            entry->length = 2;
+        } else {
+            entry->bytes[0] = (char)(0xE0 | code >> 12);
+            entry->bytes[1] = (char)(0x80 | (code >> 6 & 0x3F));
+            entry->bytes[2] = (char)(0x80 | (code & 0x3F));
+            entry->length = 3;
+        }
+    }
+}
+
+// Writes length CP866 bytes as UTF-8 and returns the number of bytes
+// written. out needs room for 3 bytes per input byte.
+size_t cp866_to_utf8(char *out, const char *text, size_t length) {
+    size_t n = 0;
+    for (size_t i = 0; i < length; i++) {
+        const Utf8Char *c = &utf8_table[(unsigned char)text[i]];
+        memcpy(out + n, c->bytes, 3);
+        n += c->length;
+    }
+    return n;
+}
+
+// Length in bytes of a well-formed UTF-8 string of 1-3 byte characters
+// (all CP866 needs), or 0 when text is not one.
+size_t utf8_length(const char *text) {
+    const unsigned char *p = (const unsigned char*)text;
+    while (*p != '\0') {
+        int extra = *p < 0x80 ? 0 : (*p & 0xE0) == 0xC0 ? 1 : (*p & 0xF0) == 0xE0 ? 2 : -1;
+        if (extra < 0) {
+            return 0;
+        }
+        p++;
+        for (int k = 0; k < extra; k++, p++) {
+            if ((*p & 0xC0) != 0x80) {
+                return 0;
+            }
+        }
+    }
+    return (size_t)(p - (const unsigned char*)text);
+}
+
+// Batch text typed next to UTF-8 output is UTF-8, older query files hold
+// raw CP866 bytes. Well-formed UTF-8 is mapped back through utf8_table,
+// anything else is copied as CP866. Returns 0 if a character has no CP866
+// equivalent and so can never match.
+int text_to_cp866(char *out, const char *text, size_t size) {
+    size_t length = utf8_length(text);
+    if (length == 0) {
+        snprintf(out, size, "%s", text);
+        return 1;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < length && n + 1 < size; n++) {
+        int c = 0;
+        if ((unsigned char)text[i] < 0x80) {
+            c = (unsigned char)text[i];
+        } else {
+            for (c = 0x80; c < 256; c++) {
+                if (memcmp(utf8_table[c].bytes, text + i, utf8_table[c].length) == 0) {
+                    break;
+                }
+            }
+            if (c == 256) {
+                return 0;
+            }
+        }
+        out[n] = (char)c;
+        i += utf8_table[c].length;
+    }
+    out[n] = '\0';
+    return 1;
+}
+
+// Length of a space-padded field without its padding.
+size_t field_length(const char *field, size_t size) {
+    const char *end = (const char*)memchr(field, '\0', size);
+    size_t length = end != NULL ? (size_t)(end - field) : size;
+    while (length > 0 && field[length - 1] == ' ') {
+        length--;
+    }
+    return length;
+}
+
+// Columns are padded by characters, not bytes, so Cyrillic rows line up.
+size_t render_field(char *out, const char *field, size_t size, int width) {
+    size_t length = field_length(field, size);
+    size_t n = cp866_to_utf8(out, field, length);
+    for (int chars = (int)length; chars < width; chars++) {
+        out[n++] = ' ';
+    }
+    return n;
+}
+
+uint16_t render_row(char *out, const Record *record) {
+    size_t n = render_field(out, record->fio, MAX_STR_SIZE, 32);
+    n += (size_t)sprintf(out + n, "  ");
+    n += render_field(out + n, record->street, STREET_SIZE, 15);
+    n += (size_t)sprintf(out + n, "  %-4d  %-3d  ", record->home, record->appartament);
+    n += render_field(out + n, record->date, DATE_SIZE, 0);
+    out[n++] = '\n';
+    return (uint16_t)n;
+}
+
+int grow_display_cache(int slots) {
+    uint32_t *offsets = (uint32_t*)realloc(display_offset, (size_t)slots * sizeof(uint32_t));
+    if (offsets == NULL) {
+        return 0;
+    }
+    display_offset = offsets;
+    uint16_t *lengths = (uint16_t*)realloc(display_length, (size_t)slots * sizeof(uint16_t));
+    if (lengths == NULL) {
+        return 0;
+    }
+    display_length = lengths;
+    memset(display_length + display_slots, 0, (size_t)(slots - display_slots) * sizeof(uint16_t));
+    display_slots = slots;
+    return 1;
+}
+
+// Room for one more row. A full arena is simply emptied: rows of edited
+// records are left behind in it, and this keeps the cache bounded.
+int reserve_display_row() {
+    if (display_arena_size + DISPLAY_ROW_MAX <= display_arena_capacity) {
+        return 1;
+    }
+    if (display_arena_capacity >= DISPLAY_ARENA_MAX) {
+        memset(display_length, 0, (size_t)display_slots * sizeof(uint16_t));
+        display_arena_size = 0;
+        return 1;
+    }
+    uint32_t capacity = display_arena_capacity ? display_arena_capacity * 2 : (64u << 10);
+    char *arena = (char*)realloc(display_arena, capacity);
+    if (arena == NULL) {
+        return 0;
+    }
+    display_arena = arena;
+    display_arena_capacity = capacity;
+    return 1;
+}
+
+const char* display_row(uint32_t id, uint16_t *length) {
+    static char scratch[DISPLAY_ROW_MAX];
+    int slots = record_capacity > record_count ? record_capacity : record_count;
+    if (((int)id >= display_slots && !grow_display_cache(slots)) || !reserve_display_row()) {
+        *length = render_row(scratch, record_at(id));
+        return scratch;
+    }
+    if (display_length[id] == 0) {
+        display_offset[id] = display_arena_size;
+        display_length[id] = render_row(display_arena + display_arena_size, record_at(id));
+        display_arena_size += display_length[id];
+    }
+    *length = display_length[id];
+    return display_arena + display_offset[id];
+}
+
+// Called whenever the record stored under id changes.
+void forget_display_row(int id) {
+    if (id < display_slots) {
+        display_length[id] = 0;
+    }
+}
+
+void free_display_cache() {
+    free(display_arena);
+    free(display_offset);
+    free(display_length);
+    display_arena = NULL;
+    display_offset = NULL;
+    display_length = NULL;
+    display_arena_size = display_arena_capacity = 0;
+    display_slots = 0;
+}
+
+void print_field(const char *field, size_t size) {
+    char text[DISPLAY_ROW_MAX];
+    fwrite(text, 1, cp866_to_utf8(text, field, field_length(field, size)), stdout);
+}
+
+// Sends a whole page with one write, so a slow link gets it in one piece.
+void write_output(const char *data, size_t size) {
+    fflush(stdout);
+#ifdef _WIN32
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD written;
+    while (size > 0 && WriteFile(out, data, (DWORD)size, &written, NULL) && written > 0) {
+        data += written;
+        size -= written;
+    }
+#else
+    while (size > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, size);
+        if (written <= 0) {
+            break;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+#endif
+}
+
+void clear_screen() {
+    fputs(CLEAR_SCREEN, stdout);
+}
+
+// The console gets UTF-8 and ANSI escapes; input keeps its code page.
+void init_console() {
+#ifdef _WIN32
+    SetConsoleOutputCP(CP_UTF8);
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(out, &mode)) {
+        SetConsoleMode(out, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    }
+#endif
+}
+
+#define HEAD_LINE "Record Full Name                         Street           Home  Apt  Date\n"
+
+void print_head() {
+    fputs(HEAD_LINE, stdout);
+}
+
+void print_record(Record *record, int i) {
+    uint16_t length;
+    const char *row = display_row((uint32_t)(record - database.records), &length);
+    printf("[%4d] ", i);
+    fwrite(row, 1, length, stdout);
+}
+
+void show_list(uint32_t ind_arr[], int n) {
+    static char page[PAGE_BUFFER_SIZE];
+    int ind = 0;
+    while (1) {
+        size_t size = (size_t)sprintf(page, "%s%s", CLEAR_SCREEN, HEAD_LINE);
+        for (int i = 0; i < 20 && (ind + i) < n; i++) {
+            uint16_t length;
+            const char *row = display_row(ind_arr[ind + i], &length);
+            size += (size_t)sprintf(page + size, "[%4d] ", ind + i + 1);
+            memcpy(page + size, row, length);
+            size += length;
+        }
+        size += (size_t)sprintf(page + size, "\nPage %d/%d\n%s\n> ", (ind / 20) + 1, (n / 20) + 1,
+                                "w: Next page\tq: Last page\te: Skip 10 next pages\n"
+                                "s: Prev page\ta: First page\td: Skip 10 prev pages\n"
+                                "Any key: Exit");
+        write_output(page, size);
+        char *chose = read_answer();
+        
+        switch (chose[0]) {
+            case 'w': ind += 20; break;
+            case 's': ind -= 20; break;
+            case 'a': ind = 0; break;
+            case 'q': ind = n - 20; break;
+            case 'd': ind -= 200; break;
+            case 'e': ind += 200; break;
+            default: return;
+        }
+        
+        if (ind > n - 20) ind = n - 20;
+        if (ind < 0) ind = 0;
+    }
+}
+
+int compare_search(const char *street, const char *key) {
+    return strncmp(street, key, 3);
+}
+
+int lower_bound_by_key(uint32_t arr[], int n, const char *key) {
+    int left = 0;
+    int right = n;
+    
+    while (left < right) {
+        int mid = left + (right - left) / 2;
+        STAT_ADD(search_probes, 1);
+        if (compare_search(record_at(arr[mid])->street, key) < 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+int upper_bound_by_key(uint32_t arr[], int n, const char *key) {
+    int left = 0;
+    int right = n;
+    
+    while (left < right) {
+        int mid = left + (right - left) / 2;
+        STAT_ADD(search_probes, 1);
+        if (compare_search(record_at(arr[mid])->street, key) <= 0) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    return left;
+}
+
+RecordSpan equal_range_by_key(uint32_t arr[], int n, const char *key) {
+    int first = lower_bound_by_key(arr, n, key);
+    int last = first + upper_bound_by_key(arr + first, n - first, key);
+    RecordSpan span = {arr + first, arr + last};
+    return span;
+}
+
+uint32_t prefix_key(const char *street) {
+    uint32_t key = 0;
+    for (int i = 0; i < 3; i++) {
+        unsigned char c = (unsigned char)street[i];
+        key = (key << 8) | c;
+        if (c == '\0') {
+            key <<= 8 * (2 - i);
+            break;
+        }
+    }
+    return key;
+}
+
+uint32_t prefix_slot(uint32_t key, uint32_t mask) {
+    return (key * 0x9E3779B1u >> 8) & mask;
+}
+
+void free_prefix_directory(PrefixDirectory *dir) {
+    free(dir->entries);
+    dir->entries = NULL;
+    dir->mask = 0;
+    dir->size = 0;
+}
+
+// Empty slots have last == 0; a stored group always ends after its first index.
+int build_prefix_directory(PrefixDirectory *dir, uint32_t arr[], int n) {
+    int groups = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || prefix_key(record_at(arr[i])->street) != prefix_key(record_at(arr[i - 1])->street)) {
+            groups++;
+        }
+    }
+
+    uint32_t capacity = 16;
+    while (capacity < (uint32_t)groups * 2) {
+        capacity <<= 1;
+    }
+
+    free_prefix_directory(dir);
+    dir->entries = (PrefixEntry*)calloc(capacity, sizeof(PrefixEntry));
+    if (dir->entries == NULL) {
+        return 0;
+    }
+    dir->mask = capacity - 1;
+
+    int first = 0;
+    for (int i = 1; i <= n; i++) {
+        uint32_t key = prefix_key(record_at(arr[first])->street);
+        if (i < n && prefix_key(record_at(arr[i])->street) == key) {
+            continue;
+        }
+        uint32_t slot = prefix_slot(key, dir->mask);
+        while (dir->entries[slot].last != 0) {
+            slot = (slot + 1) & dir->mask;
+        }
+        dir->entries[slot].key = key;
+        dir->entries[slot].first = first;
+        dir->entries[slot].last = i;
+        dir->size++;
+        first = i;
+    }
+    return 1;
+}
+
+int prefix_lookup(const PrefixDirectory *dir, const char *key, int *first, int *last) {
+    if (dir->entries == NULL) {
+        return 0;
+    }
+    uint32_t k = prefix_key(key);
+    uint32_t slot = prefix_slot(k, dir->mask);
+    while (dir->entries[slot].last != 0) {
+        STAT_ADD(directory_probes, 1);
+        if (dir->entries[slot].key == k) {
+            *first = dir->entries[slot].first;
+            *last = dir->entries[slot].last;
+            return 1;
+        }
+        slot = (slot + 1) & dir->mask;
+    }
+    return 0;
+}
+
+Queue* create_queue() {
+    Queue *q = (Queue*)malloc(sizeof(Queue));
+    q->capacity = 16;
+    q->items = (Record**)malloc(q->capacity * sizeof(Record*));
+    STAT_ADD(queue_allocations, 1);
+    q->head = q->tail = 0;
+    q->size = 0;
+    return q;
+}
+
+void reserve_queue(Queue *q, int size) {
+    if (size <= q->capacity) {
+        return;
+    }
+    
+    int capacity = q->capacity;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    
+    Record **items = (Record**)malloc((size_t)capacity * sizeof(Record*));
+    STAT_ADD(queue_allocations, 1);
+    for (int i = 0; i < q->size; i++) {
+        items[i] = q->items[(q->head + i) & (q->capacity - 1)];
+    }
+    free(q->items);
+    q->items = items;
+    q->capacity = capacity;
+    q->head = 0;
+    q->tail = q->size;
+}
+
+void enqueue(Queue *q, Record *record) { 
+    reserve_queue(q, q->size + 1);
+    q->items[q->tail] = record;
+    q->tail = (q->tail + 1) & (q->capacity - 1);
+    q->size++;
+}
+
+Record* dequeue(Queue *q) {
+    if (q->size == 0) {
+        return NULL;
+    }
+    
+    Record *record = q->items[q->head];
+    q->head = (q->head + 1) & (q->capacity - 1);
+    q->size--;
+    return record;
+}
+
+Record* queue_at(Queue *q, int i) {
+    return q->items[(q->head + i) & (q->capacity - 1)];
+}
+
+int is_queue_empty(Queue *q) {
+    return q->size == 0;
+}
+
+void reset_queue(Queue *q) {
+    q->head = q->tail = 0;
+    q->size = 0;
+}
+
+void free_queue(Queue *q) {
+    free(q->items);
+    free(q);
+}
+
+int span_size(RecordSpan span) {
+    return (int)(span.last - span.first);
+}
+
+RecordSpan find_by_key(const char *key) {
+    LATENCY_START(started);
+    int first, last;
+    RecordSpan span = {index_database, index_database};
+    if (prefix_directory.entries == NULL) {
+        span = equal_range_by_key(index_database, record_count, key);
+    } else if (prefix_lookup(&prefix_directory, key, &first, &last)) {
+        span.first = index_database + first;
+        span.last = index_database + last;
+    }
+    LATENCY_END(OP_PREFIX, started);
+    return span;
+}
+
+void enqueue_span(Queue *q, RecordSpan span) {
+    reserve_queue(q, q->size + span_size(span));
+    for (uint32_t *p = span.first; p != span.last; p++) {
+        q->items[q->tail] = record_at(*p);
+        q->tail = (q->tail + 1) & (q->capacity - 1);
+    }
+    q->size += span_size(span);
+}
+
+void print_span(RecordSpan span) {
+    printf("\n=== FOUND RECORDS ===\n");
+    printf("Records found: %d\n", span_size(span));
+    print_head();
+    
+    int i = 1;
+    for (uint32_t *p = span.first; p != span.last; p++) {
+        print_record(record_at(*p), i++);
+    }
+}
+
+void print_queue(Queue *q) {
+    if (q == NULL || is_queue_empty(q)) {
+        printf("Queue is empty\n");
+        return;
+    }
+    
+    printf("\n=== FOUND RECORDS QUEUE ===\n");
+    printf("Queue size: %d\n", q->size);
+    printf("Head: ");
+    print_field(queue_at(q, 0)->street, STREET_SIZE);
+    printf(", Tail: ");
+    print_field(queue_at(q, q->size - 1)->street, STREET_SIZE);
+    printf("\n");
+    print_head();
+    
+    for (int i = 0; i < q->size; i++) {
+        print_record(queue_at(q, i), i + 1);
+    }
+}
+
+void search_database() {
+    char search_key[4] = {0};
+    
+    do {
+        clear_screen();
+        printf("\n=== SEARCH IN DATABASE ===\n");
+        printf("Search by first 3 letters of street name\n\n");
+        
+        char *input = prompt("Enter first 3 letters of street name (or 'q' to quit)");
+        
+        if (input[0] == 'q' || input[0] == 'Q') {
+            return;
+        }
+        
+        if (strlen(input) < 3) {
+            printf("Error: Please enter at least 3 characters\n");
+            printf("Press any key to continue...");
+            getchar();
+            continue;
+        }
+        
+        strncpy(search_key, input, 3);
+        search_key[3] = '\0';
+        
+        RecordSpan span = find_by_key(search_key);
+        
+        if (span_size(span) == 0) {
+            printf("No records found for street starting with '%s'\n", search_key);
+        } else {
+            printf("Found %d records for street starting with '%s'\n", span_size(span), search_key);
+            printf("First occurrence at index: %d\n", (int)(span.first - index_database) + 1);
+            
+            print_span(span);
+        }
+        
+        char *again = prompt("\nSearch again? (y/n)");
+        if (again[0] != 'y' && again[0] != 'Y') {
+            break;
+        }
+        
+    } while (1);
+}
+
+void show_record_by_number(uint32_t arr[]) {
+    char message[64];
+    snprintf(message, sizeof(message), "Enter record number (1-%d) or 'q' to quit", record_count);
+    char *input = prompt(message);
+    
+    if (input[0] == 'q' || input[0] == 'Q') {
+        return;
+    }
+    
+    int record_number = atoi(input);
+    
+    if (record_number < 1 || record_number > record_count) {
+        printf("Invalid record number! Please enter a number between 1 and %d\n", record_count);
+        return;
+    }
+    
+    clear_screen();
+    printf("=== RECORD %d ===\n", record_number);
+    print_head();
+    print_record(record_at(arr[record_number - 1]), record_number);
+    
+    printf("\nPress any key to continue...");
+    getchar();
+    getchar();
+}
+
+TreeNode* create_tree_node(Record *record) {
+    TreeNode *node = (TreeNode*)malloc(sizeof(TreeNode));
+    node->record = record; 
+    node->left = node->right = NULL;
+    node->parent = NULL;
+    return node;
+}
+
+// DD-MM-YY (any one-character separators, 2- or 4-digit year) -> yyyymmdd,
+// or -1 if the string is not a date.
+int32_t parse_date(const char *date) {
+    int part[3] = {0, 0, 0};
+    const char *p = date;
+    
+    for (int k = 0; k < 3; k++) {
+        while (*p == ' ') p++;
+        if (*p < '0' || *p > '9') return -1;
+        for (int digits = 0; *p >= '0' && *p <= '9'; digits++, p++) {
+            if (digits == 4) return -1;
+            part[k] = part[k] * 10 + (*p - '0');
+        }
+        if (k < 2) {
+            if (*p == '\0') return -1;
+            p++;
+        }
+    }
+    
+    int year = part[2] < 100 ? part[2] + 1900 : part[2];
+    return year * 10000 + part[1] * 100 + part[0];
+}
+
+void free_date_column() {
+    free(date_column);
+    free(access_counts);
+    date_column = NULL;
+    access_counts = NULL;
+}
+
+int alloc_date_column() {
+    free_date_column();
+    date_column = (int32_t*)malloc((size_t)database.count * sizeof(int32_t));
+    access_counts = (uint32_t*)calloc((size_t)database.count, sizeof(uint32_t));
+    if (date_column == NULL || access_counts == NULL) {
+        free_date_column();
+        return 0;
+    }
+    return 1;
+}
+
+void fill_date_column() {
+    for (int i = 0; i < database.count; i++) {
+        date_column[i] = parse_date(database.records[i].date);
+    }
+}
+
+int build_date_column() {
+    if (!alloc_date_column()) {
+        return 0;
+    }
+    fill_date_column();
+    return 1;
+}
+
+int32_t record_date(const Record *record) {
+    return date_column[record - database.records];
+}
+
+void note_access(const Record *record) {
+    access_counts[record - database.records]++;
+}
+
+// Records never looked up still get weight 1 so they stay in the tree.
+int access_weight(const Record *record) {
+    uint32_t count = access_counts[record - database.records];
+    return count < ACCESS_WEIGHT_CAP ? (int)count + 1 : ACCESS_WEIGHT_CAP;
+}
+
+int compare_dates(int32_t date1, int32_t date2) {
+    if (date1 != date2) return (date1 < date2) ? -1 : 1;
+    return 0;
+}
+
+int compare_weighted_records_by_date(const void *a, const void *b) {
+    WeightedRecord *wr1 = (WeightedRecord*)a;
+    WeightedRecord *wr2 = (WeightedRecord*)b;
+    return compare_dates(wr1->date, wr2->date);
+}
+
+typedef struct {
+    int L, R;
+    int depth;
+    TreeNode **link;
+    TreeNode *parent;
+} A2Range;
+
+// Root of [L, R] is the first key whose running weight reaches half the
+// range weight. prefix[] holds running sums, so each choice is one binary
+// search, and subtrees hang directly off their parent's link.
+TreeNode* A2_by_date(Record *keys[], const int64_t prefix[], int n) {
+    TreeNode *root = NULL;
+    A2Range *stack = (A2Range*)malloc((size_t)n * sizeof(A2Range));
+    if (stack == NULL) {
+        return NULL;
+    }
+    
+    STAT_ADD(a2_builds, 1);
+    int top = 0;
+    stack[top++] = (A2Range){0, n - 1, 1, &root, NULL};
+    while (top > 0) {
+        A2Range range = stack[--top];
+        STAT_MAX(a2_max_depth, range.depth);
+        int64_t half = (prefix[range.R + 1] - prefix[range.L]) / 2;
+        int64_t target = prefix[range.L] + half;
+        
+        int lo = range.L, hi = range.R;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (prefix[mid + 1] >= target) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        
+        TreeNode *node = create_tree_node(keys[lo]);
+        node->parent = range.parent;
+        *range.link = node;
+        if (lo < range.R) {
+            stack[top++] = (A2Range){lo + 1, range.R, range.depth + 1, &node->right, node};
+        }
+        if (range.L < lo) {
+            stack[top++] = (A2Range){range.L, lo - 1, range.depth + 1, &node->left, node};
+        }
+    }
+    
+    free(stack);
+    return root;
+}
+
+// Keeps the first record of each date and sums the weights of its duplicates.
+int merge_equal_dates(Record *V[], int w[], int count, Record *keys[], int64_t weights[]) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (n > 0 && record_date(keys[n - 1]) == record_date(V[i])) {
+            weights[n - 1] += w[i];
+        } else {
+            keys[n] = V[i];
+            weights[n++] = w[i];
+        }
+    }
+    return n;
+}
+
+TreeNode* link_exact_subtree(int i, int j, int n, const int *root_of, Record *keys[], TreeNode *parent) {
+    if (i >= j) {
+        return NULL;
+    }
+    int r = root_of[i * (n + 1) + j];
+    TreeNode *node = create_tree_node(keys[r]);
+    node->parent = parent;
+    node->left = link_exact_subtree(i, r, n, root_of, keys, node);
+    node->right = link_exact_subtree(r + 1, j, n, root_of, keys, node);
+    return node;
+}
+
+// Knuth's dynamic programme over key ranges [i, j). The best root of [i, j)
+// lies between the best roots of [i, j - 1) and [i + 1, j), so the whole
+// table costs O(n^2) instead of O(n^3).
+TreeNode* build_exact_tree(Record *keys[], const int64_t weights[], const int64_t prefix[], int n) {
+    size_t cells = (size_t)(n + 1) * (n + 1);
+    int64_t *cost = (int64_t*)malloc(cells * sizeof(int64_t));
+    int *root_of = (int*)malloc(cells * sizeof(int));
+    if (cost == NULL || root_of == NULL) {
+        free(cost);
+        free(root_of);
+        return NULL;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        cost[i * (n + 1) + i] = 0;
+        cost[i * (n + 1) + i + 1] = weights[i];
+        root_of[i * (n + 1) + i + 1] = i;
+    }
+    cost[n * (n + 1) + n] = 0;
+    
+    for (int len = 2; len <= n; len++) {
+        for (int i = 0, j = len; j <= n; i++, j++) {
+            int best = root_of[i * (n + 1) + j - 1];
+            int64_t best_cost = INT64_MAX;
+            for (int r = best; r <= root_of[(i + 1) * (n + 1) + j]; r++) {
+                int64_t c = cost[i * (n + 1) + r] + cost[(r + 1) * (n + 1) + j];
+                if (c < best_cost) {
+                    best_cost = c;
+                    best = r;
+                }
+            }
+            cost[i * (n + 1) + j] = best_cost + prefix[j] - prefix[i];
+            root_of[i * (n + 1) + j] = best;
+        }
+    }
+    
+    TreeNode *root = link_exact_subtree(0, n, n, root_of, keys, NULL);
+    free(cost);
+    free(root_of);
+    return root;
+}
+
+// Sum of weight * depth over the tree, the root being at depth 1. The keys
+// come out of an in-order walk in the same order as weights[].
+int64_t tree_path_cost(TreeNode *root, const int64_t weights[], int *rank, int depth) {
+    if (root == NULL) {
+        return 0;
+    }
+    int64_t cost = tree_path_cost(root->left, weights, rank, depth + 1);
+    cost += weights[(*rank)++] * depth;
+    return cost + tree_path_cost(root->right, weights, rank, depth + 1);
+}
+
+TreeNode* build_optimal_tree_from_queue_by_date(Queue *q, TreeBuildStats *stats) {
+    if (is_queue_empty(q)) {
+        return NULL;
+    }
+    
+    double started = now_seconds();
+    int count = q->size;
+    Record **V = (Record**)malloc(count * sizeof(Record*));
+    int *w = (int*)malloc(count * sizeof(int));
+    
+    for (int i = 0; i < count; i++) {
+        V[i] = queue_at(q, i);
+        w[i] = access_weight(V[i]);
+    }
+    
+    WeightedRecord *temp = (WeightedRecord*)malloc(count * sizeof(WeightedRecord));
+    for (int i = 0; i < count; i++) {
+        temp[i].record = V[i];
+        temp[i].date = record_date(V[i]);
+        temp[i].weight = w[i];
+    }
+    
+    qsort(temp, count, sizeof(WeightedRecord), compare_weighted_records_by_date);
+    
+    for (int i = 0; i < count; i++) {
+        V[i] = temp[i].record;
+        w[i] = temp[i].weight;
+    }
+    
+    free(temp);
+    
+    Record **keys = (Record**)malloc(count * sizeof(Record*));
+    int64_t *weights = (int64_t*)malloc(count * sizeof(int64_t));
+    int64_t *prefix = (int64_t*)malloc((count + 1) * sizeof(int64_t));
+    int n = merge_equal_dates(V, w, count, keys, weights);
+    prefix[0] = 0;
+    for (int i = 0; i < n; i++) {
+        prefix[i + 1] = prefix[i] + weights[i];
+    }
+    
+    TreeNode *root = NULL;
+    TreeMethod method = tree_method == TREE_EXACT && n <= EXACT_TREE_MAX_KEYS ? TREE_EXACT : TREE_A2;
+    if (method == TREE_EXACT) {
+        root = build_exact_tree(keys, weights, prefix, n);
+        if (root == NULL) {
+            method = TREE_A2;
+        }
+    }
+    if (method == TREE_A2) {
+        root = A2_by_date(keys, prefix, n);
+    }
+    
+    if (stats != NULL) {
+        stats->seconds = now_seconds() - started;
+        stats->method = method;
+        stats->keys = n;
+        stats->weight = prefix[n];
+        int rank = 0;
+        stats->cost = tree_path_cost(root, weights, &rank, 1);
+    }
+    
+    free(V);
+    free(w);
+    free(keys);
+    free(weights);
+    free(prefix);
+    
+    return root;
+}
+
+void print_tree_inorder(TreeNode *root, int *count) {
+    if (root != NULL) {
+        print_tree_inorder(root->left, count);
+        print_record(root->record, (*count)++);
+        print_tree_inorder(root->right, count);
+    }
+}
+
+void print_tree_stats(const TreeBuildStats *stats) {
+    printf("%d distinct dates, weighted path cost %lld (%.2f comparisons per lookup), built in %.3f ms\n",
+           stats->keys, (long long)stats->cost,
+           stats->weight > 0 ? (double)stats->cost / (double)stats->weight : 0.0, stats->seconds * 1e3);
+}
+
+void print_tree(TreeNode *root, const TreeBuildStats *stats) {
+    printf("\n=== OPTIMAL SEARCH TREE (by DATE) ===\n");
+    printf("Tree built using %s algorithm with access-frequency weights\n",
+           stats->method == TREE_EXACT ? "exact Knuth" : "A2");
+    if (tree_method == TREE_EXACT && stats->method == TREE_A2) {
+        printf("Exact build is limited to %d dates, A2 used instead\n", EXACT_TREE_MAX_KEYS);
+    }
+    print_tree_stats(stats);
+    print_head();
+    int count = 1;
+    print_tree_inorder(root, &count);
+}
+
+// Accepts DD-MM-YY, DD.MM.YY and DD.MM.YYYY; -1 if the input is not a valid date.
+int32_t compile_date_query(const char *input) {
+    int32_t date = parse_date(input);
+    if (date < 0) {
+        return -1;
+    }
+    int day = date % 100;
+    int month = date / 100 % 100;
+    if (day < 1 || day > 31 || month < 1 || month > 12) {
+        return -1;
+    }
+    return date;
+}
+
+TreeNode* search_tree_by_date(TreeNode *root, int32_t date) {
+    STAT_ADD(tree_searches, 1);
+    for (int depth = 1; root != NULL; depth++) {
+        STAT_ADD(tree_search_steps, 1);
+        STAT_MAX(tree_search_max_depth, depth);
+        int cmp = compare_dates(date, record_date(root->record));
+        if (cmp == 0) {
+            return root;
+        }
+        root = cmp < 0 ? root->left : root->right;
+    }
+    return NULL;
+}
+
+TreeNode* tree_lower_bound(TreeNode *root, int32_t date) {
+    TreeNode *result = NULL;
+    STAT_ADD(tree_searches, 1);
+    for (int depth = 1; root != NULL; depth++) {
+        STAT_ADD(tree_search_steps, 1);
+        STAT_MAX(tree_search_max_depth, depth);
+        if (compare_dates(record_date(root->record), date) >= 0) {
+            result = root;
+            root = root->left;
+        } else {
+            root = root->right;
+        }
+    }
+    return result;
+}
+
+TreeNode* tree_successor(TreeNode *node) {
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL) {
+            node = node->left;
+        }
+        return node;
+    }
+    while (node->parent != NULL && node->parent->right == node) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+int search_tree_by_date_range(TreeNode *root, int32_t start_date, int32_t end_date,
+                              RecordVisitor visit, void *context) {
+    int found = 0;
+    for (TreeNode *node = tree_lower_bound(root, start_date);
+         node != NULL && compare_dates(record_date(node->record), end_date) <= 0;
+         node = tree_successor(node)) {
+        note_access(node->record);
+        visit(node->record, context);
+        found++;
+    }
+    return found;
+}
+
+int count_tree_nodes(TreeNode *root) {
+    if (root == NULL) {
+        return 0;
+    }
+    return count_tree_nodes(root->left) + 1 + count_tree_nodes(root->right);
+}
+
+// Copies the tree into in-order arrays; node i of flat is the i-th date.
+int flatten_tree(TreeNode *node, FrozenNode flat[], Record *records[], int32_t dates[],
+                 int *next, int *height, int depth) {
+    if (node == NULL) {
+        return -1;
+    }
+    if (depth > *height) {
+        *height = depth;
+    }
+    int left = flatten_tree(node->left, flat, records, dates, next, height, depth + 1);
+    int i = (*next)++;
+    int right = flatten_tree(node->right, flat, records, dates, next, height, depth + 1);
+
+    flat[i].date = record_date(node->record);
+    flat[i].rank = i;
+    flat[i].child[0] = left;
+    flat[i].child[1] = right;
+    records[i] = node->record;
+    dates[i] = flat[i].date;
+    return i;
+}
+
+void veb_layout(const FrozenNode flat[], int node, int h, int pos[], int *next);
+
+void veb_bottom(const FrozenNode flat[], int node, int depth, int top, int h, int pos[], int *next) {
+    if (node < 0) {
+        return;
+    }
+    if (depth == top) {
+        veb_layout(flat, node, h, pos, next);
+        return;
+    }
+    veb_bottom(flat, flat[node].child[0], depth + 1, top, h, pos, next);
+    veb_bottom(flat, flat[node].child[1], depth + 1, top, h, pos, next);
+}
+
+// Lays out the nodes within h levels below node: the top half of the
+// levels first, then every subtree hanging below it, each recursively.
+void veb_layout(const FrozenNode flat[], int node, int h, int pos[], int *next) {
+    if (node < 0) {
+        return;
+    }
+    if (h == 1) {
+        pos[node] = (*next)++;
+        return;
+    }
+    int top = h / 2;
+    veb_layout(flat, node, top, pos, next);
+    veb_bottom(flat, node, 0, top, h - top, pos, next);
+}
+
+void bfs_layout(const FrozenNode flat[], int root, int n, int pos[]) {
+    int *queue = (int*)malloc((size_t)n * sizeof(int));
+    int head = 0, tail = 0;
+    queue[tail++] = root;
+    while (head < tail) {
+        int node = queue[head];
+        pos[node] = head++;
+        for (int c = 0; c < 2; c++) {
+            if (flat[node].child[c] >= 0) {
+                queue[tail++] = flat[node].child[c];
+            }
+        }
+    }
+    free(queue);
+}
+
+// Same shape as the pointer tree, stored in one array: breadth-first
+// (Eytzinger) order for shallow trees, van Emde Boas order for deep ones.
+// The root is always nodes[0].
+FrozenTree* freeze_tree(TreeNode *root) {
+    int n = count_tree_nodes(root);
+    if (n == 0) {
+        return NULL;
+    }
+
+    FrozenTree *tree = (FrozenTree*)malloc(sizeof(FrozenTree));
+    FrozenNode *flat = (FrozenNode*)malloc((size_t)n * sizeof(FrozenNode));
+    int *pos = (int*)malloc((size_t)n * sizeof(int));
+    tree->nodes = (FrozenNode*)malloc((size_t)n * sizeof(FrozenNode));
+    tree->records = (Record**)malloc((size_t)n * sizeof(Record*));
+    tree->dates = (int32_t*)malloc((size_t)n * sizeof(int32_t));
+    tree->size = n;
+    tree->height = 0;
+
+    int next = 0;
+    int flat_root = flatten_tree(root, flat, tree->records, tree->dates, &next, &tree->height, 1);
+
+    tree->veb = tree->height > FROZEN_BFS_MAX_HEIGHT;
+    if (tree->veb) {
+        next = 0;
+        veb_layout(flat, flat_root, tree->height, pos, &next);
+    } else {
+        bfs_layout(flat, flat_root, n, pos);
+    }
+
+    for (int i = 0; i < n; i++) {
+        FrozenNode *node = &tree->nodes[pos[i]];
+        node->date = flat[i].date;
+        node->rank = flat[i].rank;
+        for (int c = 0; c < 2; c++) {
+            node->child[c] = flat[i].child[c] >= 0 ? pos[flat[i].child[c]] : -1;
+        }
+    }
+
+    free(flat);
+    free(pos);
+    return tree;
+}
+
+void free_frozen_tree(FrozenTree *tree) {
+    if (tree != NULL) {
+        free(tree->nodes);
+        free(tree->records);
+        free(tree->dates);
+        free(tree);
+    }
+}
+
+// Rank of the first date >= the given one, or size if there is none.
+// The only branch in the loop is the exit test.
+int frozen_lower_bound(const FrozenTree *tree, int32_t date) {
+    int result = tree->size;
+    int i = 0;
+    STAT_ADD(tree_searches, 1);
+    STAT_MAX(tree_search_max_depth, tree->height);
+    while (i >= 0) {
+        const FrozenNode *node = &tree->nodes[i];
+        STAT_ADD(tree_search_steps, 1);
+        PREFETCH(&tree->nodes[node->child[0] & ~(node->child[0] >> 31)]);
+        PREFETCH(&tree->nodes[node->child[1] & ~(node->child[1] >> 31)]);
+        int go_right = node->date < date;
+        int keep = -go_right;
+        result = (result & keep) | (node->rank & ~keep);
+        i = node->child[go_right];
+    }
+    return result;
+}
+
+Record* frozen_search_by_date(const FrozenTree *tree, int32_t date) {
+    int rank = frozen_lower_bound(tree, date);
+    if (rank < tree->size && tree->dates[rank] == date) {
+        return tree->records[rank];
+    }
+    return NULL;
+}
+
+int frozen_search_by_date_range(const FrozenTree *tree, int32_t start_date, int32_t end_date,
+                                RecordVisitor visit, void *context) {
+    int rank = frozen_lower_bound(tree, start_date), first = rank;
+    for (; rank < tree->size && tree->dates[rank] <= end_date; rank++) {
+        note_access(tree->records[rank]);
+        visit(tree->records[rank], context);
+    }
+    return rank - first;
+}
+
+void free_tree(TreeNode *root) {
+    if (root != NULL) {
+        free_tree(root->left);
+        free_tree(root->right);
+        free(root);
     }
+}
+
+void build_date_tree(DateTree *tree) {
+    LATENCY_START(started);
+    free_frozen_tree(tree->frozen);
+    free_tree(tree->root);
+    tree->root = build_optimal_tree_from_queue_by_date(tree->queue, &tree->stats);
+    tree->frozen = freeze_trees ? freeze_tree(tree->root) : NULL;
     
-    int record_number = atoi(input);
+    tree->accesses_at_build = 0;
+    for (int i = 0; i < tree->queue->size; i++) {
+        tree->accesses_at_build += access_counts[queue_at(tree->queue, i) - database.records];
+    }
+    tree->lookups_since_build = 0;
+    LATENCY_END(OP_TREE_BUILD, started);
+}
+
+void free_date_tree(DateTree *tree) {
+    free_frozen_tree(tree->frozen);
+    free_tree(tree->root);
+    tree->frozen = NULL;
+    tree->root = NULL;
+}
+
+// Rebuild once the lookups served since the last build outweigh the counts it was built from.
+int rebuild_date_tree_if_stale(DateTree *tree) {
+    if (is_queue_empty(tree->queue) || tree->lookups_since_build < REBUILD_MIN_LOOKUPS ||
+        tree->lookups_since_build < tree->accesses_at_build) {
+        return 0;
+    }
+    build_date_tree(tree);
+    return 1;
+}
+
+Record* find_in_date_tree(DateTree *tree, int32_t date) {
+    LATENCY_START(started);
+    Record *result = NULL;
+    if (tree->frozen != NULL) {
+        result = frozen_search_by_date(tree->frozen, date);
+    } else {
+        TreeNode *node = search_tree_by_date(tree->root, date);
+        result = node != NULL ? node->record : NULL;
+    }
+    tree->lookups_since_build++;
+    if (result != NULL) {
+        note_access(result);
+    }
+    LATENCY_END(OP_DATE, started);
+    return result;
+}
+
+int visit_date_range(DateTree *tree, int32_t start_date, int32_t end_date, RecordVisitor visit, void *context) {
+    LATENCY_START(started);
+    tree->lookups_since_build++;
+    int found;
+    if (tree->frozen != NULL) {
+        found = frozen_search_by_date_range(tree->frozen, start_date, end_date, visit, context);
+    } else {
+        found = search_tree_by_date_range(tree->root, start_date, end_date, visit, context);
+    }
+    LATENCY_END(OP_RANGE, started);
+    return found;
+}
+
+void print_numbered_record(Record *record, void *context) {
+    int *count = (int*)context;
+    print_record(record, (*count)++);
+}
+
+void search_in_tree_by_date(DateTree *tree) {
+    do {
+        printf("\n=== SEARCH IN OPTIMAL TREE BY DATE ===\n");
+        printf("Note: Date format in database: DD-MM-YY (e.g., 26-12-96)\n");
+        printf("You can search using: DD-MM-YY, DD.MM.YY, or DD.MM.YYYY\n\n");
+        
+        char *search_type = prompt("1: Exact date search\n2: Date range search\n0: Back to menu");
+        
+        switch (search_type[0]) {
+            case '1': {
+                char *input_date = prompt("Enter date to search (e.g., 26-12-96 or 26.12.1996)");
+                int32_t date = compile_date_query(input_date);
+                if (date < 0) {
+                    printf("Invalid date '%s'\n", input_date);
+                    break;
+                }
+                Record *result = find_in_date_tree(tree, date);
+                if (result == NULL) {
+                    printf("Record with date '%s' not found in optimal tree\n", input_date);
+                } else {
+                    printf("Record found in optimal tree:\n");
+                    print_head();
+                    print_record(result, 1);
+                }
+                break;
+            }
+            case '2': {
+                char start_date_input[20], end_date_input[20];
+                
+                printf("Enter start date (e.g., 01-01-96 or 01.01.1996)\n> ");
+                scanf("%19s", start_date_input);
+                
+                printf("Enter end date (e.g., 31-12-96 or 31.12.1996)\n> ");
+                scanf("%19s", end_date_input);
+                
+                int32_t start_date = compile_date_query(start_date_input);
+                int32_t end_date = compile_date_query(end_date_input);
+                if (start_date < 0 || end_date < 0) {
+                    printf("Invalid date '%s'\n", start_date < 0 ? start_date_input : end_date_input);
+                    break;
+                }
+                
+                printf("\nRecords in date range %s - %s:\n", start_date_input, end_date_input);
+                print_head();
+                int count = 1;
+                visit_date_range(tree, start_date, end_date, print_numbered_record, &count);
+                
+                if (count == 1) {
+                    printf("No records found in specified date range\n");
+                } else {
+                    printf("\nTotal records found: %d\n", count - 1);
+                }
+                break;
+            }
+            case '0':
+                return;
+            default:
+                printf("Invalid choice\n");
+        }
+        
+        if (rebuild_date_tree_if_stale(tree)) {
+            printf("\nAccess pattern changed, optimal tree rebuilt from %lld recorded lookups\n",
+                   (long long)tree->accesses_at_build);
+            print_tree_stats(&tree->stats);
+        }
+        
+        char *again = prompt("\nSearch again? (y/n)");
+        if (again[0] != 'y' && again[0] != 'Y') {
+            break;
+        }
+    } while (1);
+}
+
+#define CHECKSUM_SEED 14695981039346656037ULL
+
+// Murmur3's 64-bit finalizer: every input bit can flip every output bit.
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Each 64-bit word is mixed on its own and folded in with a rotate and an
+// odd multiply. Every step is a bijection, so changing any single word always
+// changes the result. Leftover bytes make one last zero-padded word.
+uint64_t checksum_data(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t i = 0;
+    uint64_t word;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        memcpy(&word, bytes + i, sizeof(word));
+        hash ^= mix64(word);
+        hash = (hash << 29 | hash >> 35) * 0x9E3779B97F4A7C15ULL;
+    }
+    if (i < size) {
+        word = 0;
+        memcpy(&word, bytes + i, size - i);
+        hash ^= mix64(word);
+        hash = (hash << 29 | hash >> 35) * 0x9E3779B97F4A7C15ULL;
+    }
+    return mix64(hash ^ size);
+}
+
+uint64_t checksum_index(const uint32_t sorted[], int n, const PrefixEntry entries[], uint32_t capacity) {
+    uint64_t hash = checksum_data(CHECKSUM_SEED, sorted, (size_t)n * sizeof(uint32_t));
+    hash = checksum_data(hash, date_column, (size_t)n * sizeof(int32_t));
+    return checksum_data(hash, entries, capacity * sizeof(PrefixEntry));
+}
+
+// Fills sorted[], date_column and the prefix directory from the sidecar file.
+// Returns 0 and leaves sorted[] as the identity permutation if the file is
+// missing, damaged or belongs to another version of the data.
+int load_index_file(const char *filename, uint32_t sorted[]) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    IndexHeader header;
+    int ok = fread(&header, sizeof(header), 1, file) == 1 &&
+             memcmp(header.magic, INDEX_MAGIC, 4) == 0 && header.version == INDEX_VERSION &&
+             header.data_size == database.size && header.data_mtime == database.mtime &&
+             header.count == database.count &&
+             (header.directory_capacity & (header.directory_capacity - 1)) == 0 &&
+             header.checksum == checksum_data(CHECKSUM_SEED, database.records, database.size);
+    
+    size_t n = (size_t)database.count;
+    ok = ok && fread(sorted, sizeof(uint32_t), n, file) == n &&
+         fread(date_column, sizeof(int32_t), n, file) == n;
+    
+    free_prefix_directory(&prefix_directory);
+    if (ok && header.directory_capacity > 0) {
+        prefix_directory.entries = (PrefixEntry*)malloc(header.directory_capacity * sizeof(PrefixEntry));
+        ok = prefix_directory.entries != NULL &&
+             fread(prefix_directory.entries, sizeof(PrefixEntry), header.directory_capacity, file) ==
+             header.directory_capacity;
+        if (ok) {
+            prefix_directory.mask = header.directory_capacity - 1;
+            prefix_directory.size = 0;
+            for (uint32_t slot = 0; slot < header.directory_capacity; slot++) {
+                prefix_directory.size += prefix_directory.entries[slot].last != 0;
+            }
+        }
+    }
+    fclose(file);
+    
+    ok = ok && header.index_checksum == checksum_index(sorted, database.count, prefix_directory.entries,
+                                                       header.directory_capacity);
+    if (!ok) {
+        free_prefix_directory(&prefix_directory);
+        for (size_t i = 0; i < n; i++) {
+            sorted[i] = (uint32_t)i;
+        }
+    }
+    return ok;
+}
+
+// Written to a temporary file first so a crash never leaves a torn index behind.
+int save_index_file(const char *filename, const uint32_t sorted[]) {
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE *file = fopen(temp_name, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, 4);
+    header.version = INDEX_VERSION;
+    header.data_size = database.size;
+    header.data_mtime = database.mtime;
+    header.checksum = checksum_data(CHECKSUM_SEED, database.records, database.size);
+    header.count = database.count;
+    header.directory_capacity = prefix_directory.entries != NULL ? prefix_directory.mask + 1 : 0;
+    header.index_checksum = checksum_index(sorted, database.count, prefix_directory.entries,
+                                           header.directory_capacity);
+    
+    size_t n = (size_t)database.count;
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(sorted, sizeof(uint32_t), n, file) == n &&
+             fwrite(date_column, sizeof(int32_t), n, file) == n &&
+             fwrite(prefix_directory.entries, sizeof(PrefixEntry), header.directory_capacity, file) ==
+             header.directory_capacity;
+    ok = fclose(file) == 0 && ok;
+    
+    if (ok) {
+        remove(filename);
+        ok = rename(temp_name, filename) == 0;
+    }
+    if (!ok) {
+        remove(temp_name);
+    }
+    return ok;
+}
+
+int write_record_at(int id, const Record *record) {
+    FILE *file = fopen(DATABASE_FILE, "r+b");
+    if (file == NULL) {
+        return 0;
+    }
+#ifdef _WIN32
+    int ok = _fseeki64(file, (int64_t)id * sizeof(Record), SEEK_SET) == 0;
+#else
+    int ok = fseeko(file, (off_t)id * sizeof(Record), SEEK_SET) == 0;
+#endif
+    ok = ok && fwrite(record, sizeof(Record), 1, file) == 1;
+    return fclose(file) == 0 && ok;
+}
+
+int truncate_database(int count) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(DATABASE_FILE, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER end;
+    end.QuadPart = (LONGLONG)count * sizeof(Record);
+    int ok = SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file);
+    CloseHandle(file);
+    return ok;
+#else
+    return truncate(DATABASE_FILE, (off_t)count * sizeof(Record)) == 0;
+#endif
+}
+
+// The mapping has to follow the file whenever its length changes. Record
+// ids stay valid, but any Record pointer taken before this call does not.
+void remap_database() {
+    unmap_database(&database);
+    if (map_database(&database, DATABASE_FILE) != 1) {
+        printf("Error: could not map '%s' again after changing it\n", DATABASE_FILE);
+        exit(1);
+    }
+}
+
+int reserve_records(uint32_t **unsorted, uint32_t **sorted, int n) {
+    if (n <= record_capacity) {
+        return 1;
+    }
+    int capacity = record_capacity * 2 > n ? record_capacity * 2 : n;
+    uint32_t *new_unsorted = (uint32_t*)realloc(*unsorted, (size_t)capacity * sizeof(uint32_t));
+    if (new_unsorted != NULL) *unsorted = new_unsorted;
+    uint32_t *new_sorted = (uint32_t*)realloc(*sorted, (size_t)capacity * sizeof(uint32_t));
+    if (new_sorted != NULL) {
+        // Searches go through index_database, which must not keep the old block
+        *sorted = new_sorted;
+        index_database = new_sorted;
+    }
+    int32_t *new_dates = (int32_t*)realloc(date_column, (size_t)capacity * sizeof(int32_t));
+    if (new_dates != NULL) date_column = new_dates;
+    uint32_t *new_counts = (uint32_t*)realloc(access_counts, (size_t)capacity * sizeof(uint32_t));
+    if (new_counts != NULL) access_counts = new_counts;
+    if (new_unsorted == NULL || new_sorted == NULL || new_dates == NULL || new_counts == NULL) {
+        return 0;
+    }
+    record_capacity = capacity;
+    return 1;
+}
+
+int find_prefix_slot(const PrefixDirectory *dir, uint32_t key) {
+    uint32_t slot = prefix_slot(key, dir->mask);
+    while (dir->entries[slot].last != 0) {
+        if (dir->entries[slot].key == key) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & dir->mask;
+    }
+    return -1;
+}
+
+// Moves every range except the one for skip_key that starts at or after from.
+void shift_prefix_ranges(PrefixDirectory *dir, int from, int delta, uint32_t skip_key) {
+    for (uint32_t slot = 0; slot <= dir->mask; slot++) {
+        PrefixEntry *entry = &dir->entries[slot];
+        if (entry->last != 0 && entry->key != skip_key && entry->first >= from) {
+            entry->first += delta;
+            entry->last += delta;
+        }
+    }
+}
+
+// Backward-shift deletion: pull later entries of the probe run into the
+// hole unless that would move them in front of their home slot.
+void delete_prefix_slot(PrefixDirectory *dir, uint32_t hole) {
+    for (uint32_t next = (hole + 1) & dir->mask; dir->entries[next].last != 0;
+         next = (next + 1) & dir->mask) {
+        uint32_t home = prefix_slot(dir->entries[next].key, dir->mask);
+        if (((next - home) & dir->mask) >= ((next - hole) & dir->mask)) {
+            dir->entries[hole] = dir->entries[next];
+            hole = next;
+        }
+    }
+    memset(&dir->entries[hole], 0, sizeof(PrefixEntry));
+    dir->size--;
+}
+
+int index_position(uint32_t ids[], int n, uint32_t id) {
+    SortKey key, probe;
+    make_sort_key(&key, id);
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        make_sort_key(&probe, ids[mid]);
+        if (compare_keys(&probe, &key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// ids[] has room for n + 1 entries.
+void index_insert(uint32_t ids[], int n, uint32_t id) {
+    int position = index_position(ids, n, id);
+    memmove(&ids[position + 1], &ids[position], (size_t)(n - position) * sizeof(uint32_t));
+    ids[position] = id;
     
-    if (record_number < 1 || record_number > N) {
-        printf("Invalid record number! Please enter a number between 1 and %d\n", N);
+    PrefixDirectory *dir = &prefix_directory;
+    if (dir->entries == NULL) {
+        return;
+    }
+    uint32_t key = prefix_key(record_at(id)->street);
+    int slot = find_prefix_slot(dir, key);
+    if (slot < 0 && (dir->size + 1) * 2 > (int)dir->mask + 1) {
+        if (!build_prefix_directory(dir, ids, n + 1)) {
+            printf("Warning: not enough memory for the prefix directory, using binary search\n");
+        }
+        return;
+    }
+    shift_prefix_ranges(dir, position, 1, key);
+    if (slot >= 0) {
+        dir->entries[slot].last++;
         return;
     }
+    uint32_t free_slot = prefix_slot(key, dir->mask);
+    while (dir->entries[free_slot].last != 0) {
+        free_slot = (free_slot + 1) & dir->mask;
+    }
+    dir->entries[free_slot].key = key;
+    dir->entries[free_slot].first = position;
+    dir->entries[free_slot].last = position + 1;
+    dir->size++;
+}
+
+// Must run while the record still holds the data it was indexed under.
+void index_remove(uint32_t ids[], int n, uint32_t id) {
+    int position = index_position(ids, n, id);
+    memmove(&ids[position], &ids[position + 1], (size_t)(n - position - 1) * sizeof(uint32_t));
     
-    system("cls");
-    printf("=== RECORD %d ===\n", record_number);
-    print_head();
-    print_record(arr[record_number - 1], record_number);
+    PrefixDirectory *dir = &prefix_directory;
+    if (dir->entries == NULL) {
+        return;
+    }
+    uint32_t key = prefix_key(record_at(id)->street);
+    int slot = find_prefix_slot(dir, key);
+    shift_prefix_ranges(dir, position + 1, -1, key);
+    if (--dir->entries[slot].last == dir->entries[slot].first) {
+        delete_prefix_slot(dir, (uint32_t)slot);
+    }
+}
+
+void fill_field(char *field, size_t size, const char *text) {
+    size_t length = strlen(text);
+    memset(field, ' ', size - 1);
+    memcpy(field, text, length < size - 1 ? length : size - 1);
+    field[size - 1] = '\0';
+}
+
+// The DD-MM-YY field only holds years 1900-1999.
+int set_record_date(Record *record, const char *text) {
+    int32_t date = compile_date_query(text);
+    if (date < 19000000 || date > 19991231) {
+        return 0;
+    }
+    char field[DATE_SIZE];
+    snprintf(field, sizeof(field), "%02d-%02d-%02d", date % 100, date / 100 % 100, date / 10000 % 100);
+    fill_field(record->date, DATE_SIZE, field);
+    return 1;
+}
+
+int read_record(Record *record) {
+    memset(record, 0, sizeof(Record));
+    fill_field(record->fio, MAX_STR_SIZE, prompt_line("Enter full name"));
+    fill_field(record->street, STREET_SIZE, prompt_line("Enter street"));
+    record->home = (short)atoi(prompt("Enter house number"));
+    record->appartament = (short)atoi(prompt("Enter apartment number"));
     
-    printf("\nPress any key to continue...");
+    if (!set_record_date(record, prompt("Enter date (e.g., 26-12-96 or 26.12.1996)"))) {
+        printf("Invalid date: the DD-MM-YY field only holds years 1900-1999\n");
+        return 0;
+    }
+    return 1;
+}
+
+int read_record_number(const char *action) {
+    char message[64];
+    snprintf(message, sizeof(message), "Enter number of the record to %s (1-%d)", action, record_count);
+    int number = atoi(prompt(message));
+    if (number < 1 || number > record_count) {
+        printf("Invalid record number! Please enter a number between 1 and %d\n", record_count);
+        return -1;
+    }
+    return number - 1;
+}
+
+void finish_edit(const char *message) {
+    printf("%s\n", message);
+    printf("Press any key to continue...");
     getchar();
     getchar();
 }
 
-TreeNode* create_tree_node(Record *record) {
-    TreeNode *node = (TreeNode*)malloc(sizeof(TreeNode));
-    node->record = record; 
-    node->left = node->right = NULL;
-    return node;
+// The edits themselves, shared by the menu and --batch. Each returns NULL
+// on success or a message saying why nothing was changed.
+const char* insert_record(uint32_t **unsorted, uint32_t **sorted, const Record *record) {
+    if (!reserve_records(unsorted, sorted, record_count + 1)) {
+        return "Error: not enough memory for another record";
+    }
+    if (!write_record_at(record_count, record)) {
+        return "Error: could not write to 'database.dat'";
+    }
+    remap_database();
+    
+    int id = record_count;
+    date_column[id] = parse_date(record->date);
+    access_counts[id] = 0;
+    forget_display_row(id);
+    (*unsorted)[id] = (uint32_t)id;
+    index_insert(*sorted, record_count, (uint32_t)id);
+    record_count++;
+    database_changed = 1;
+    return NULL;
+}
+
+const char* replace_record(uint32_t sorted[], int id, const Record *record) {
+    index_remove(sorted, record_count, (uint32_t)id);
+    if (!write_record_at(id, record)) {
+        index_insert(sorted, record_count - 1, (uint32_t)id);
+        return "Error: could not write to 'database.dat'";
+    }
+    // The old mapping may not show the write, and its mtime is stale for
+    // the index sidecar; the sort key is read back only after remapping.
+    remap_database();
+    
+    date_column[id] = parse_date(record->date);
+    access_counts[id] = 0;
+    forget_display_row(id);
+    index_insert(sorted, record_count - 1, (uint32_t)id);
+    database_changed = 1;
+    return NULL;
+}
+
+// The last record moves into the freed slot, so the file just shrinks by
+// one record and the unsorted list stays the identity.
+const char* remove_record(uint32_t sorted[], int id) {
+    if (record_count == 1) {
+        return "The last record cannot be deleted";
+    }
+    int last = record_count - 1;
+    Record moved = database.records[last];
+    index_remove(sorted, record_count, (uint32_t)id);
+    if (id != last) {
+        index_remove(sorted, record_count - 1, (uint32_t)last);
+    }
+    
+    unmap_database(&database);
+    int ok = (id == last || write_record_at(id, &moved)) && truncate_database(last);
+    remap_database();
+    if (!ok) {
+        database_changed = 1;
+        record_count = database.count;
+        fill_date_column();
+        free_display_cache();
+        for (int i = 0; i < record_count; i++) {
+            sorted[i] = (uint32_t)i;
+        }
+        sort_index(sorted, record_count);
+        build_prefix_directory(&prefix_directory, sorted, record_count);
+        return "Error: could not update 'database.dat', it was read again";
+    }
+    
+    record_count = last;
+    if (id != last) {
+        date_column[id] = date_column[last];
+        access_counts[id] = access_counts[last];
+        forget_display_row(id);
+        index_insert(sorted, record_count - 1, (uint32_t)id);
+    }
+    database_changed = 1;
+    return NULL;
+}
+
+void add_record(uint32_t **unsorted, uint32_t **sorted) {
+    Record record;
+    if (!read_record(&record)) {
+        finish_edit("Record not added");
+        return;
+    }
+    const char *error = insert_record(unsorted, sorted, &record);
+    finish_edit(error != NULL ? error : "Record added");
 }
 
-int compare_dates(const char *date1, const char *date2) {
-    int day1, month1, year1;
-    int day2, month2, year2;
-    
-    sscanf(date1, "%d-%d-%d", &day1, &month1, &year1);
-    sscanf(date2, "%d-%d-%d", &day2, &month2, &year2);
-    
-    if (year1 < 100) year1 += 1900;
-    if (year2 < 100) year2 += 1900;
-    
-    if (year1 != year2) return (year1 < year2) ? -1 : 1;
-    if (month1 != month2) return (month1 < month2) ? -1 : 1;
-    if (day1 != day2) return (day1 < day2) ? -1 : 1;
-    return 0;
+void edit_record(uint32_t sorted[]) {
+    int id = read_record_number("edit");
+    if (id < 0) {
+        return;
+    }
+    Record record;
+    if (!read_record(&record)) {
+        finish_edit("Record not changed");
+        return;
+    }
+    const char *error = replace_record(sorted, id, &record);
+    finish_edit(error != NULL ? error : "Record changed");
 }
 
-int compare_weighted_records_by_date(const void *a, const void *b) {
-    WeightedRecord *wr1 = (WeightedRecord*)a;
-    WeightedRecord *wr2 = (WeightedRecord*)b;
-    return compare_dates(wr1->record->date, wr2->record->date);
+void delete_record(uint32_t sorted[]) {
+    if (record_count == 1) {
+        finish_edit("The last record cannot be deleted");
+        return;
+    }
+    int id = read_record_number("delete");
+    if (id < 0) {
+        return;
+    }
+    const char *error = remove_record(sorted, id);
+    finish_edit(error != NULL ? error : "Record deleted");
 }
 
-TreeNode* insert_to_tree_by_date(TreeNode *root, Record *record) {
-    if (root == NULL) {
-        return create_tree_node(record);
+typedef struct {
+    uint32_t key;
+    int used;
+    DateTree tree;
+} CachedTree;
+
+typedef struct {
+    FILE *out;
+    long query;
+    long rows;
+} BatchOutput;
+
+// One date tree per street key, direct-mapped by the prefix directory hash.
+DateTree* cached_date_tree(CachedTree cache[], const char *street_key) {
+    uint32_t key = prefix_key(street_key);
+    CachedTree *entry = &cache[prefix_slot(key, BATCH_CACHE_SIZE - 1)];
+    if (entry->used && entry->key == key) {
+        return &entry->tree;
     }
-    
-    int cmp = compare_dates(record->date, root->record->date);
-    if (cmp < 0) {
-        root->left = insert_to_tree_by_date(root->left, record);
-    } else if (cmp > 0) {
-        root->right = insert_to_tree_by_date(root->right, record);
+    if (!entry->used) {
+        entry->tree.queue = create_queue();
+        entry->used = 1;
     }
-    
-    return root;
+    free_date_tree(&entry->tree);
+    entry->key = key;
+    reset_queue(entry->tree.queue);
+    enqueue_span(entry->tree.queue, find_by_key(street_key));
+    if (!is_queue_empty(entry->tree.queue)) {
+        build_date_tree(&entry->tree);
+    }
+    return &entry->tree;
 }
 
-int generate_random_weight() {
-    return rand() % 100 + 1;
+// Fields are space padded on disk; the padding is not part of the value.
+// Output is UTF-8, the same as --export.
+void write_field(FILE *out, const char *field, size_t size) {
+    char text[MAX_STR_SIZE * 3];
+    fwrite(text, 1, cp866_to_utf8(text, field, field_length(field, size)), out);
 }
 
-void A2_by_date(int L, int R, int w[], Record *V[], TreeNode **root) {
-    int wes = 0, sum = 0;
-    int i;
-    
-    if (L <= R) {
-        for (i = L; i <= R; i++)
-            wes += w[i];
-
-        for (i = L; i <= R - 1; i++) {
-            if ((sum < (wes / 2)) && ((sum + w[i]) > (wes / 2)))
-                break;
-            sum += w[i];
+// Cached trees point into the mapping, which every edit replaces.
+void forget_cached_trees(CachedTree cache[]) {
+    for (int i = 0; i < BATCH_CACHE_SIZE; i++) {
+        if (cache[i].used) {
+            free_date_tree(&cache[i].tree);
+            free_queue(cache[i].tree.queue);
+            cache[i].used = 0;
         }
-
-        *root = insert_to_tree_by_date(*root, V[i]);
-        A2_by_date(L, i - 1, w, V, root);
-        A2_by_date(i + 1, R, w, V, root);
     }
 }
 
-TreeNode* build_optimal_tree_from_queue_by_date(Queue *q) {
-    if (is_queue_empty(q)) {
-        return NULL;
+// Fills a record from the tab-separated fields of an add or edit line:
+// full name, street, house, apartment, date.
+const char* parse_batch_record(Record *record, char *fields[], int count) {
+    if (count != 5) {
+        return "expected full name, street, house, apartment and date separated by tabs";
     }
-    
-    int count = q->size;
-    Record **V = (Record**)malloc(count * sizeof(Record*));
-    int *w = (int*)malloc(count * sizeof(int));
-    
-    QueueNode *current = q->head;
-    for (int i = 0; i < count && current != NULL; i++) {
-        V[i] = current->record;
-        w[i] = generate_random_weight();
-        current = current->next;
+    char text[MAX_STR_SIZE * 3];
+    memset(record, 0, sizeof(Record));
+    if (!text_to_cp866(text, fields[0], sizeof(text))) {
+        return "full name has characters outside CP866";
     }
-    
-    WeightedRecord *temp = (WeightedRecord*)malloc(count * sizeof(WeightedRecord));
-    for (int i = 0; i < count; i++) {
-        temp[i].record = V[i];
-        temp[i].weight = w[i];
+    fill_field(record->fio, MAX_STR_SIZE, text);
+    if (!text_to_cp866(text, fields[1], sizeof(text))) {
+        return "street has characters outside CP866";
     }
-    
-    qsort(temp, count, sizeof(WeightedRecord), compare_weighted_records_by_date);
-    
-    for (int i = 0; i < count; i++) {
-        V[i] = temp[i].record;
-        w[i] = temp[i].weight;
+    fill_field(record->street, STREET_SIZE, text);
+    record->home = (short)atoi(fields[2]);
+    record->appartament = (short)atoi(fields[3]);
+    if (!set_record_date(record, fields[4])) {
+        return "invalid date, the DD-MM-YY field only holds years 1900-1999";
     }
-    
-    free(temp);
-    
-    TreeNode *root = NULL;
-    A2_by_date(0, count - 1, w, V, &root);
-    
-    free(V);
-    free(w);
-    
-    return root;
+    return NULL;
 }
 
-void print_tree_inorder(TreeNode *root, int *count) {
-    if (root != NULL) {
-        print_tree_inorder(root->left, count);
-        print_record(root->record, (*count)++);
-        print_tree_inorder(root->right, count);
+// Runs one add, edit or delete line. Record numbers are 1-based positions
+// in the unsorted list; a delete moves the last record into the gap.
+const char* run_batch_change(char *line, uint32_t **unsorted, uint32_t **sorted) {
+    char *fields[8];
+    int count = 0;
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char *field = line; field != NULL && count < 8; count++) {
+        fields[count] = field;
+        field = strchr(field, '\t');
+        if (field != NULL) {
+            *field++ = '\0';
+        }
     }
+    if (count == 1) {
+        // delete N may also be written with a space
+        char *space = strchr(line, ' ');
+        if (space != NULL) {
+            *space = '\0';
+            fields[count++] = space + 1;
+        }
+    }
+    
+    Record record;
+    const char *error;
+    if (strcmp(fields[0], "add") == 0) {
+        error = parse_batch_record(&record, fields + 1, count - 1);
+        return error != NULL ? error : insert_record(unsorted, sorted, &record);
+    }
+    int number = count >= 2 ? atoi(fields[1]) : 0;
+    if (number < 1 || number > record_count) {
+        return "record number out of range";
+    }
+    if (strcmp(fields[0], "edit") == 0) {
+        error = parse_batch_record(&record, fields + 2, count - 2);
+        return error != NULL ? error : replace_record(*sorted, number - 1, &record);
+    }
+    return count == 2 ? remove_record(*sorted, number - 1) : "expected: delete NUMBER";
 }
 
-void print_tree(TreeNode *root) {
-    printf("\n=== OPTIMAL SEARCH TREE (by DATE) ===\n");
-    printf("Tree built using A2 algorithm with RANDOM weights\n");
-    print_head();
-    int count = 1;
-    print_tree_inorder(root, &count);
+void write_batch_row(Record *record, void *context) {
+    BatchOutput *output = (BatchOutput*)context;
+    fprintf(output->out, "%ld\t", output->query);
+    write_field(output->out, record->fio, MAX_STR_SIZE);
+    fputc('\t', output->out);
+    write_field(output->out, record->street, STREET_SIZE);
+    fprintf(output->out, "\t%d\t%d\t", record->home, record->appartament);
+    write_field(output->out, record->date, DATE_SIZE);
+    fputc('\n', output->out);
+    output->rows++;
 }
 
-TreeNode* search_tree_by_date(TreeNode *root, const char *input_date) {
-    if (root == NULL) return NULL;
-    
-    char search_date[20];
-    if (strchr(input_date, '.')) {
-        int day, month, year;
-        sscanf(input_date, "%d.%d.%d", &day, &month, &year);
-        if (year < 100) year += 1900;
-        sprintf(search_date, "%02d-%02d-%02d", day, month, year % 100);
-    } else {
-        strcpy(search_date, input_date);
+// Reads one query per line:
+//   prefix KEY
+//   date KEY DATE
+//   range KEY START END
+// and writes one tab-separated UTF-8 row per matching record, tagged with
+// the query's line number. Keys are street prefixes in UTF-8 or CP866.
+// Changes are fed the same way, fields separated by tabs:
+//   add FIO STREET HOUSE APARTMENT DATE
+//   edit NUMBER FIO STREET HOUSE APARTMENT DATE
+//   delete NUMBER
+// They print nothing; a change that fails is reported on stderr.
+int run_batch(const char *filename, uint32_t **unsorted, uint32_t **sorted) {
+    FILE *in = filename != NULL ? fopen(filename, "r") : stdin;
+    if (in == NULL) {
+        fprintf(stderr, "Error: cannot open '%s'\n", filename);
+        return 1;
     }
+    static char buffer[BATCH_BUFFER_SIZE];
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
     
-    int cmp = compare_dates(search_date, root->record->date);
-    if (cmp == 0) {
-        return root;
-    } else if (cmp < 0) {
-        return search_tree_by_date(root->left, input_date);
-    } else {
-        return search_tree_by_date(root->right, input_date);
+    CachedTree *cache = (CachedTree*)calloc(BATCH_CACHE_SIZE, sizeof(CachedTree));
+    if (cache == NULL) {
+        fprintf(stderr, "Error: not enough memory for the tree cache\n");
+        return 1;
     }
-}
-
-void search_tree_by_date_range(TreeNode *root, const char *input_start_date, const char *input_end_date, int *count) {
-    if (root != NULL) {
-        char start_date[20], end_date[20];
-        
-        if (strchr(input_start_date, '.')) {
-            int day, month, year;
-            sscanf(input_start_date, "%d.%d.%d", &day, &month, &year);
-            if (year < 100) year += 1900;
-            sprintf(start_date, "%02d-%02d-%02d", day, month, year % 100);
-        } else {
-            strcpy(start_date, input_start_date);
+    
+    BatchOutput output = {stdout, 0, 0};
+    long queries = 0, changes = 0, errors = 0;
+    char line[512];
+    double started = now_seconds();
+    while (fgets(line, sizeof(line), in) != NULL) {
+        output.query++;
+        char command[16], text[64], key[64], first[32], second[32];
+        int fields = sscanf(line, "%15s %63s %31s %31s", command, text, first, second);
+        if (fields <= 0 || command[0] == '#') {
+            continue;
         }
-        
-        if (strchr(input_end_date, '.')) {
-            int day, month, year;
-            sscanf(input_end_date, "%d.%d.%d", &day, &month, &year);
-            if (year < 100) year += 1900;
-            sprintf(end_date, "%02d-%02d-%02d", day, month, year % 100);
-        } else {
-            strcpy(end_date, input_end_date);
+#ifdef INSTRUMENT
+        if (strcmp(command, "stats") == 0) {
+            fflush(stdout);
+            write_stats_json(stderr);
+            continue;
         }
-                
-        int cmp_start = compare_dates(root->record->date, start_date);
-        int cmp_end = compare_dates(root->record->date, end_date);
+#endif
+        queries++;
         
-        if (cmp_start >= 0) {
-            search_tree_by_date_range(root->left, input_start_date, input_end_date, count);
+        if (strcmp(command, "add") == 0 || strcmp(command, "edit") == 0 ||
+            strcmp(command, "delete") == 0) {
+            const char *error = run_batch_change(line, unsorted, sorted);
+            if (error != NULL) {
+                fprintf(stderr, "line %ld: %s\n", output.query, error);
+                errors++;
+            } else {
+                changes++;
+            }
+            forget_cached_trees(cache);
+            continue;
         }
         
-        if (cmp_start >= 0 && cmp_end <= 0) {
-            print_record(root->record, (*count)++);
+        int32_t start = fields >= 3 ? compile_date_query(first) : -1;
+        int32_t end = fields >= 4 ? compile_date_query(second) : -1;
+        if (strcmp(command, "prefix") != 0 && strcmp(command, "date") != 0 && strcmp(command, "range") != 0) {
+            fprintf(stderr, "line %ld: unknown command '%s'\n", output.query, command);
+            errors++;
+            continue;
+        }
+        if (fields >= 2 && !text_to_cp866(key, text, sizeof(key))) {
+            fprintf(stderr, "line %ld: street key '%s' has characters outside CP866\n", output.query, text);
+            errors++;
+            continue;
+        }
+        if (fields < 2 || strlen(key) < 3) {
+            fprintf(stderr, "line %ld: expected a street key of at least 3 characters\n", output.query);
+            errors++;
+            continue;
         }
+        key[3] = '\0';
         
-        if (cmp_end <= 0) {
-            search_tree_by_date_range(root->right, input_start_date, input_end_date, count);
+        if (strcmp(command, "prefix") == 0) {
+            RecordSpan span = find_by_key(key);
+            for (uint32_t *p = span.first; p < span.last; p++) {
+                write_batch_row(record_at(*p), &output);
+            }
+        } else if (strcmp(command, "date") == 0 && start >= 0) {
+            DateTree *tree = cached_date_tree(cache, key);
+            Record *result = find_in_date_tree(tree, start);
+            if (result != NULL) {
+                write_batch_row(result, &output);
+            }
+            rebuild_date_tree_if_stale(tree);
+        } else if (strcmp(command, "range") == 0 && start >= 0 && end >= 0) {
+            DateTree *tree = cached_date_tree(cache, key);
+            visit_date_range(tree, start, end, write_batch_row, &output);
+            rebuild_date_tree_if_stale(tree);
+        } else {
+            fprintf(stderr, "line %ld: cannot parse query: %s", output.query, line);
+            errors++;
         }
     }
-}
-
-void search_in_tree_by_date(TreeNode *root) {
-    printf("\n=== SEARCH IN OPTIMAL TREE BY DATE ===\n");
-    printf("Note: Date format in database: DD-MM-YY (e.g., 26-12-96)\n");
-    printf("You can search using: DD-MM-YY, DD.MM.YY, or DD.MM.YYYY\n\n");
+    fflush(stdout);
+    double elapsed = now_seconds() - started;
     
-    char *search_type = prompt("1: Exact date search\n2: Date range search\n0: Back to menu");
+    fprintf(stderr, "%ld queries (%ld changes), %ld rows, %ld errors in %.3f s (%.2f us per query)\n",
+            queries, changes, output.rows, errors, elapsed, queries > 0 ? elapsed * 1e6 / queries : 0.0);
     
-    switch (search_type[0]) {
-        case '1': {
-            char *input_date = prompt("Enter date to search (e.g., 26-12-96 or 26.12.1996)");
-            TreeNode *result = search_tree_by_date(root, input_date);
-            if (result == NULL) {
-                printf("Record with date '%s' not found in optimal tree\n", input_date);
-            } else {
-                printf("Record found in optimal tree:\n");
-                print_head();
-                print_record(result->record, 1);
-            }
-            break;
+    forget_cached_trees(cache);
+    free(cache);
+    if (in != stdin) {
+        fclose(in);
+    }
+    return errors > 0 ? 2 : 0;
+}
+
+typedef enum {
+    EXPORT_NONE,
+    EXPORT_CSV,
+    EXPORT_JSONL
+} ExportFormat;
+
+// A text field as a quoted CSV value: quotes are doubled, commas and line
+// breaks are safe inside the quotes.
+size_t csv_field(char *out, const char *field, size_t size) {
+    size_t length = field_length(field, size);
+    size_t n = 0;
+    out[n++] = '"';
+    for (size_t i = 0; i < length; i++) {
+        const Utf8Char *c = &utf8_table[(unsigned char)field[i]];
+        if (field[i] == '"') {
+            out[n++] = '"';
         }
-            case '2': {
-            char start_date_input[20], end_date_input[20];
-            
-            printf("Enter start date (e.g., 01-01-96 or 01.01.1996)\n> ");
-            scanf("%19s", start_date_input);
-            
-            printf("Enter end date (e.g., 31-12-96 or 31.12.1996)\n> ");
-            scanf("%19s", end_date_input);
-            
-            // Очистка буфера ввода
-            int c;
-            while ((c = getchar()) != '\n' && c != EOF);
-            
-            printf("DEBUG BEFORE CALL: start='%s', end='%s'\n", start_date_input, end_date_input);
-            
-            printf("\nRecords in date range %s - %s:\n", start_date_input, end_date_input);
-            print_head();
-            int count = 1;
-            search_tree_by_date_range(root, start_date_input, end_date_input, &count);
-            
-            if (count == 1) {
-                printf("No records found in specified date range\n");
-            } else {
-                printf("\nTotal records found: %d\n", count - 1);
-            }
-            break;
+        memcpy(out + n, c->bytes, 3);
+        n += c->length;
+    }
+    out[n++] = '"';
+    return n;
+}
+
+size_t json_field(char *out, const char *field, size_t size) {
+    size_t length = field_length(field, size);
+    size_t n = 0;
+    out[n++] = '"';
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)field[i];
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+        } else if (c < 0x20) {
+            n += (size_t)sprintf(out + n, "\\u%04x", c);
+            continue;
         }
-        case '0':
-            return;
-        default:
-            printf("Invalid choice\n");
+        memcpy(out + n, utf8_table[c].bytes, 3);
+        n += utf8_table[c].length;
     }
-    
-    printf("\nPress any key to continue...");
-    getchar();
-    getchar();
+    out[n++] = '"';
+    return n;
 }
 
-void free_tree(TreeNode *root) {
-    if (root != NULL) {
-        free_tree(root->left);
-        free_tree(root->right);
-        free(root);
+size_t put_text(char *out, const char *text) {
+    size_t length = strlen(text);
+    memcpy(out, text, length);
+    return length;
+}
+
+size_t put_int(char *out, int value) {
+    char digits[12];
+    int count = 0;
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    do {
+        digits[count++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    size_t n = 0;
+    if (value < 0) {
+        out[n++] = '-';
+    }
+    while (count > 0) {
+        out[n++] = digits[--count];
+    }
+    return n;
+}
+
+size_t export_row(char *out, const Record *record, ExportFormat format) {
+    size_t n = 0;
+    if (format == EXPORT_CSV) {
+        n += csv_field(out + n, record->fio, MAX_STR_SIZE);
+        out[n++] = ',';
+        n += csv_field(out + n, record->street, STREET_SIZE);
+        out[n++] = ',';
+        n += put_int(out + n, record->home);
+        out[n++] = ',';
+        n += put_int(out + n, record->appartament);
+        out[n++] = ',';
+        n += csv_field(out + n, record->date, DATE_SIZE);
+    } else {
+        n += put_text(out + n, "{\"fio\":");
+        n += json_field(out + n, record->fio, MAX_STR_SIZE);
+        n += put_text(out + n, ",\"street\":");
+        n += json_field(out + n, record->street, STREET_SIZE);
+        n += put_text(out + n, ",\"home\":");
+        n += put_int(out + n, record->home);
+        n += put_text(out + n, ",\"apartment\":");
+        n += put_int(out + n, record->appartament);
+        n += put_text(out + n, ",\"date\":");
+        n += json_field(out + n, record->date, DATE_SIZE);
+        out[n++] = '}';
     }
+    out[n++] = '\n';
+    return n;
 }
 
-void mainloop(Record *unsorted_ind_array[], Record *sorted_ind_array[]) {
-    for (int i = 0; i < N; i++) {
-        index_database[i] = sorted_ind_array[i];
+// Streams every record in ids order as UTF-8. Rows are gathered in one
+// fixed buffer that goes out in a single write whenever it fills up, so
+// memory stays the same whatever the size of the database.
+int run_export(ExportFormat format, const uint32_t ids[], const char *filename) {
+    FILE *out = filename != NULL ? fopen(filename, "wb") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Error: cannot create '%s'\n", filename);
+        return 1;
+    }
+    setvbuf(out, NULL, _IONBF, 0);
+    
+    static char buffer[EXPORT_BUFFER_SIZE];
+    size_t used = 0;
+    int ok = 1;
+    double started = now_seconds();
+    uint64_t written = 0;
+    if (format == EXPORT_CSV) {
+        used = (size_t)sprintf(buffer, "fio,street,home,apartment,date\n");
+    }
+    for (int i = 0; i < record_count && ok; i++) {
+        if (i + 8 < record_count) {
+            PREFETCH(record_at(ids[i + 8]));
+        }
+        used += export_row(buffer + used, record_at(ids[i]), format);
+        if (used + EXPORT_ROW_MAX > sizeof(buffer) || i + 1 == record_count) {
+            ok = fwrite(buffer, 1, used, out) == used;
+            written += used;
+            used = 0;
+        }
+    }
+    if (out != stdout && fclose(out) != 0) {
+        ok = 0;
+    }
+    double elapsed = now_seconds() - started;
+    
+    if (!ok) {
+        fprintf(stderr, "Error: could not write '%s'\n", filename != NULL ? filename : "stdout");
+        return 1;
     }
+    fprintf(stderr, "%d records, %.1f MB in %.3f s (%.1f MB/s)\n", record_count, written / 1e6,
+            elapsed, elapsed > 0 ? written / 1e6 / elapsed : 0.0);
+    return 0;
+}
+
+void mainloop(uint32_t **unsorted_ind_array, uint32_t **sorted_ind_array) {
+    index_database = *sorted_ind_array;
+    Queue *q = create_queue();
     
     while (1) {
-        system("cls");
+        clear_screen();
         printf("\n=== DATABASE MANAGEMENT SYSTEM ===\n");
-        printf("Total records: %d\n\n", N);
+        printf("Total records: %d\n\n", record_count);
         printf("SORT KEY: Street + House number\n");
-        printf("SEARCH METHOD: Binary Search (Version 2)\n");
-        printf("QUEUE: Classical implementation with head and tail\n\n");
+        printf("SORT METHOD: %s\n", sort_method == SORT_RADIX ? "LSD Radix Sort" : "Williams-Floyd Heap Sort");
+        printf("SEARCH METHOD: Prefix directory (hash of 3-letter keys)\n");
+        printf("QUEUE: Ring buffer with head and tail\n\n");
         
         char *chose = prompt("1: Show unsorted list\n"
                              "2: Show sorted list (by street and house)\n"
-                             "3: Binary search by street key\n"
+                             "3: Search by street key\n"
                              "4: Show record by number\n"
                              "5: Create queue and build OPTIMAL search tree by DATE\n"
+                             "6: Add record\n"
+                             "7: Edit record\n"
+                             "8: Delete record\n"
+#ifdef INSTRUMENT
+                             "9: Export statistics\n"
+#endif
                              "0: Exit");
         
         switch (chose[0]) {
             case '1':
                 printf("\n=== UNSORTED LIST ===\n");
-                show_list(unsorted_ind_array, N);
+                show_list(*unsorted_ind_array, record_count);
                 break;
             case '2':
                 printf("\n=== SORTED LIST (by street and house number) ===\n");
-                show_list(sorted_ind_array, N);
+                show_list(*sorted_ind_array, record_count);
                 break;
             case '3':
                 search_database();
                 break;
             case '4':
                 printf("\n=== SHOW RECORD BY NUMBER ===\n");
-                show_record_by_number(unsorted_ind_array);
+                show_record_by_number(*unsorted_ind_array);
                 break;
             case '5':
                 printf("\n=== CREATE QUEUE AND BUILD OPTIMAL SEARCH TREE BY DATE ===\n");
@@ -675,29 +3077,29 @@ void mainloop(Record *unsorted_ind_array[], Record *sorted_ind_array[]) {
                     char search_key[4] = {0};
                     strncpy(search_key, key, 3);
                     
-                    int first_index;
-                    if (binary_search(index_database, search_key, &first_index)) {
-                        Queue *q = create_queue();
-                        
-                        for (int i = first_index; i < N; i++) {
-                            if (compare_search(index_database[i]->street, search_key) == 0) {
-                                enqueue(q, index_database[i]);
-                            } else {
-                                break;
-                            }
-                        }
+                    RecordSpan span = find_by_key(search_key);
+                    if (span_size(span) > 0) {
+                        reset_queue(q);
+                        enqueue_span(q, span);
                         
                         print_queue(q);
                         
-                        printf("\nBuilding optimal search tree with random weights...\n");
-                        TreeNode *tree = build_optimal_tree_from_queue_by_date(q);
+                        printf("\nBuilding optimal search tree from access frequencies...\n");
+                        DateTree tree;
+                        memset(&tree, 0, sizeof(tree));
+                        tree.queue = q;
+                        build_date_tree(&tree);
                         printf("Optimal tree built successfully!\n");
                         
-                        print_tree(tree);
-                        search_in_tree_by_date(tree);
+                        print_tree(tree.root, &tree.stats);
+                        
+                        if (tree.frozen != NULL) {
+                            printf("Tree frozen: %d nodes, height %d, %s layout\n", tree.frozen->size,
+                                   tree.frozen->height, tree.frozen->veb ? "van Emde Boas" : "breadth-first");
+                        }
+                        search_in_tree_by_date(&tree);
                         
-                        free_queue(q);
-                        free_tree(tree);
+                        free_date_tree(&tree);
                     } else {
                         printf("No records found for street starting with '%s'\n", search_key);
                         printf("Press any key to continue...");
@@ -705,7 +3107,32 @@ void mainloop(Record *unsorted_ind_array[], Record *sorted_ind_array[]) {
                     }
                 }
                 break;
+            case '6':
+                printf("\n=== ADD RECORD ===\n");
+                add_record(unsorted_ind_array, sorted_ind_array);
+                break;
+            case '7':
+                printf("\n=== EDIT RECORD ===\n");
+                edit_record(*sorted_ind_array);
+                break;
+            case '8':
+                printf("\n=== DELETE RECORD ===\n");
+                delete_record(*sorted_ind_array);
+                break;
+#ifdef INSTRUMENT
+            case '9':
+                if (save_stats(stats_file)) {
+                    printf("Statistics written to '%s'\n", stats_file);
+                } else {
+                    printf("Error: could not write '%s'\n", stats_file);
+                }
+                printf("Press any key to continue...");
+                getchar();
+                getchar();
+                break;
+#endif
             case '0':
+                free_queue(q);
                 return;
             default:
                 printf("Invalid choice. Please try again.\n");
@@ -715,40 +3142,358 @@ void mainloop(Record *unsorted_ind_array[], Record *sorted_ind_array[]) {
     }
 }
 
-int main() {
-    srand(time(NULL));
+int write_bench_file(const char *filename, const Database *source, int n) {
+    FILE *file = fopen(filename, "wb");
+    if (!file) {
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        Record record = source->records[i % source->count];
+        record.home = (short int)(record.home + (i / source->count) % 1000);
+        if (fwrite(&record, sizeof(Record), 1, file) != 1) {
+            fclose(file);
+            return 0;
+        }
+    }
+    fclose(file);
+    return 1;
+}
+
+// Queue and tree timings for the street keys the main benchmark samples.
+// The tree is built for the largest of their queues, the worst case for A2.
+void benchmark_date_tree(const Database *source, uint32_t ids[], int queries) {
+    Queue *q = create_queue();
+    RecordSpan largest = {ids, ids};
+    long enqueued = 0;
+    double t0 = now_seconds();
+    for (int k = 0; k < queries; k++) {
+        const char *key = source->records[(int)(((int64_t)k * 7919) % source->count)].street;
+        RecordSpan span = equal_range_by_key(ids, record_count, key);
+        reset_queue(q);
+        enqueue_span(q, span);
+        enqueued += q->size;
+        if (span_size(span) > span_size(largest)) {
+            largest = span;
+        }
+    }
+    double t1 = now_seconds();
+
+    DateTree tree;
+    memset(&tree, 0, sizeof(tree));
+    tree.queue = q;
+    reset_queue(q);
+    enqueue_span(q, largest);
+    double t2 = now_seconds();
+    build_date_tree(&tree);
+    double t3 = now_seconds();
+
+    int lookups = 1000000;
+    long hits = 0;
+    double t4 = now_seconds();
+    for (int k = 0; k < lookups && q->size > 0; k++) {
+        int32_t date = record_date(queue_at(q, (int)(((int64_t)k * 7919) % q->size)));
+        hits += find_in_date_tree(&tree, date + (k & 1)) != NULL;
+    }
+    double t5 = now_seconds();
+
+    printf("%10s  queue %.3f us (%.1f records), %s tree %.2f ms (%d records, %d dates), "
+           "date lookup %.1f ns (%.0f%% hits)\n", "trees:", (t1 - t0) * 1e6 / queries,
+           (double)enqueued / queries, tree.stats.method == TREE_EXACT ? "exact" : "A2", (t3 - t2) * 1e3,
+           q->size, tree.stats.keys, (t5 - t4) * 1e9 / lookups, hits * 100.0 / lookups);
+
+    free_date_tree(&tree);
+    free_queue(q);
+}
+
+void run_benchmark(int sizes[], int size_count) {
+    Database source;
+    if (map_database(&source, DATABASE_FILE) != 1) {
+        printf("Error: benchmark needs a valid 'database.dat' as the record source\n");
+        return;
+    }
+
+    printf("%10s  %10s  %10s  %10s  %5s  %12s  %12s  %12s\n", "records", "load, ms", "heap, ms",
+           "radix, ms", "same", "bsearch, us", "dir, us", "hits/query");
+    for (int s = 0; s < size_count; s++) {
+        char filename[64];
+        snprintf(filename, sizeof(filename), "bench_%d.dat", sizes[s]);
+        if (!write_bench_file(filename, &source, sizes[s])) {
+            printf("Error: cannot write %s\n", filename);
+            continue;
+        }
+
+        double t0 = now_seconds();
+        if (map_database(&database, filename) != 1) {
+            printf("Error: cannot map %s\n", filename);
+            remove(filename);
+            continue;
+        }
+        record_count = database.count;
+        uint32_t *ids = make_index_array(record_count);
+        double t1 = now_seconds();
+
+        uint32_t *radix_ids = make_index_array(record_count);
+        SortMethod saved_method = sort_method;
+        int saved_threads = sort_threads;
+        sort_threads = 1;
+        double t2 = now_seconds();
+        sort_method = SORT_HEAP;
+        sort_index(ids, record_count);
+        double t3 = now_seconds();
+        sort_method = SORT_RADIX;
+        sort_index(radix_ids, record_count);
+        double t4 = now_seconds();
+        int same = memcmp(ids, radix_ids, (size_t)record_count * sizeof(uint32_t)) == 0;
+
+        char parallel[256] = "";
+        size_t used = 0;
+        for (int threads = 2; threads <= saved_threads;
+             threads = (threads < saved_threads && threads * 2 > saved_threads) ? saved_threads : threads * 2) {
+            for (int i = 0; i < record_count; i++) {
+                radix_ids[i] = (uint32_t)i;
+            }
+            sort_threads = threads;
+            sort_method = saved_method;
+            double p0 = now_seconds();
+            sort_index(radix_ids, record_count);
+            double p1 = now_seconds();
+            int parallel_same = memcmp(ids, radix_ids, (size_t)record_count * sizeof(uint32_t)) == 0;
+            used += snprintf(parallel + used, sizeof(parallel) - used, "  %dt: %.1f ms%s",
+                             threads, (p1 - p0) * 1e3, parallel_same ? "" : " (DIFFERS)");
+            if (used >= sizeof(parallel)) break;
+        }
+        sort_method = saved_method;
+        sort_threads = saved_threads;
+        free(radix_ids);
+
+        int queries = 1000;
+        long found = 0;
+        double t5 = now_seconds();
+        for (int q = 0; q < queries; q++) {
+            const char *key = source.records[(int)(((int64_t)q * 7919) % source.count)].street;
+            found += span_size(equal_range_by_key(ids, record_count, key));
+        }
+        double t6 = now_seconds();
+
+        PrefixDirectory dir = {NULL, 0, 0};
+        build_prefix_directory(&dir, ids, record_count);
+        int dir_queries = queries * 1000;
+        long dir_found = 0;
+        double t7 = now_seconds();
+        for (int q = 0; q < dir_queries; q++) {
+            const char *key = source.records[(int)(((int64_t)(q % queries) * 7919) % source.count)].street;
+            int first_index, last_index;
+            if (prefix_lookup(&dir, key, &first_index, &last_index)) {
+                dir_found += last_index - first_index;
+            }
+        }
+        double t8 = now_seconds();
+        free_prefix_directory(&dir);
+        if (dir_found != found * 1000) {
+            printf("Warning: prefix directory and binary search disagree\n");
+        }
+
+        printf("%10d  %10.1f  %10.1f  %10.1f  %5s  %12.3f  %12.3f  %12.1f\n", record_count,
+               (t1 - t0) * 1e3, (t3 - t2) * 1e3, (t4 - t3) * 1e3, same ? "yes" : "NO",
+               (t6 - t5) * 1e6 / queries, (t8 - t7) * 1e6 / dir_queries, (double)found / queries);
+        if (parallel[0] != '\0') {
+            printf("%10s %s\n", "parallel:", parallel);
+        }
+
+        if (build_date_column()) {
+            benchmark_date_tree(&source, ids, queries);
+            free_date_column();
+        }
+
+        free(ids);
+        unmap_database(&database);
+        remove(filename);
+    }
+    unmap_database(&source);
+}
+
+int main(int argc, char *argv[]) {
+    init_utf8_table();
+    int bench = 0;
+    int batch = 0;
+    const char *batch_file = NULL;
+    ExportFormat export_format = EXPORT_NONE;
+    int export_sorted = 0;
+    const char *export_file = NULL;
+    int sizes[16] = {4000, 1000000, 10000000};
+    int size_count = 3;
     
-    printf("Loading data...\n");
-    Node *root = load_to_memory();
-    if (!root) {
-        printf("Error: File 'database.dat' not found\n");
-        printf("Make sure database.dat is in the same directory as the program\n");
-        printf("Press any key to exit...");
-        getchar();
-        return 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            bench = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                size_count = 0;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                batch_file = argv[++i];
+            }
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "csv") == 0) {
+                export_format = EXPORT_CSV;
+            } else if (strcmp(argv[i], "jsonl") == 0) {
+                export_format = EXPORT_JSONL;
+            } else {
+                printf("Error: export format must be csv or jsonl\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--sorted") == 0) {
+            export_sorted = 1;
+        } else if (strcmp(argv[i], "--sort=heap") == 0) {
+            sort_method = SORT_HEAP;
+        } else if (strcmp(argv[i], "--sort=radix") == 0) {
+            sort_method = SORT_RADIX;
+        } else if (strcmp(argv[i], "--tree=a2") == 0) {
+            tree_method = TREE_A2;
+        } else if (strcmp(argv[i], "--tree=exact") == 0) {
+            tree_method = TREE_EXACT;
+        } else if (strcmp(argv[i], "--frozen-tree") == 0) {
+            freeze_trees = 1;
+        } else if (strncmp(argv[i], "--stats=", 8) == 0) {
+#ifdef INSTRUMENT
+            stats_file = argv[i] + 8;
+#else
+            printf("Error: --stats needs a build with -DINSTRUMENT\n");
+            return 1;
+#endif
+        } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+            sort_threads = atoi(argv[i] + 10);
+            if (sort_threads < 1 || sort_threads > MAX_THREADS) {
+                printf("Error: thread count must be between 1 and %d\n", MAX_THREADS);
+                return 1;
+            }
+        } else if (bench && argv[i][0] != '-' && size_count < 16) {
+            sizes[size_count++] = atoi(argv[i]);
+        } else if (export_format != EXPORT_NONE && argv[i][0] != '-' && export_file == NULL) {
+            export_file = argv[i];
+        } else {
+            printf("Usage: %s [--sort=heap|radix] [--threads=N] [--tree=a2|exact] [--frozen-tree]\n"
+                   "       [--stats=file.json]\n"
+                   "       [--bench [records...] | --batch [queries] |\n"
+                   "        --export csv|jsonl [--sorted] [file]]\n"
+                   "Batch keys may be UTF-8 or CP866; batch and export output is UTF-8.\n", argv[0]);
+            return 1;
+        }
     }
     
-    Record *unsorted_ind_arr[N];
-    Record *sorted_ind_arr[N];
+    if (bench) {
+        run_benchmark(sizes, size_count);
+        return 0;
+    }
     
-    make_index_array(unsorted_ind_arr, root, N);
-    make_index_array(sorted_ind_arr, root, N);
+    int interactive = !batch && export_format == EXPORT_NONE;
+    FILE *log = interactive ? stdout : stderr;
+    fprintf(log, "Loading data...\n");
+    LATENCY_START(load_started);
+    int status = map_database(&database, DATABASE_FILE);
+    if (status == 0) {
+        fprintf(log, "Error: File 'database.dat' not found\n");
+        fprintf(log, "Make sure database.dat is in the same directory as the program\n");
+        if (interactive) {
+            printf("Press any key to exit...");
+            getchar();
+        }
+        return 1;
+    }
+    if (status < 0) {
+        fprintf(log, "Error: 'database.dat' is not a valid database file\n");
+        fprintf(log, "File size must be a non-zero multiple of %d bytes\n", (int)sizeof(Record));
+        if (interactive) {
+            printf("Press any key to exit...");
+            getchar();
+        }
+        return 1;
+    }
+    record_count = database.count;
     
-    printf("Sorting data by street and house number using Heap Sort...\n");
-    HeapSort(sorted_ind_arr, N);
+    if (!alloc_date_column()) {
+        fprintf(log, "Error: not enough memory for %d records\n", record_count);
+        unmap_database(&database);
+        return 1;
+    }
     
-    printf("Data loaded successfully. Total records: %d\n", N);
-    printf("Press any key to continue...");
-    getchar();
+    uint32_t *unsorted_ind_arr = make_index_array(record_count);
+    uint32_t *sorted_ind_arr = make_index_array(record_count);
+    if (unsorted_ind_arr == NULL || sorted_ind_arr == NULL) {
+        fprintf(log, "Error: not enough memory for %d records\n", record_count);
+        free_date_column();
+        free(unsorted_ind_arr);
+        free(sorted_ind_arr);
+        unmap_database(&database);
+        return 1;
+    }
     
-    mainloop(unsorted_ind_arr, sorted_ind_arr);
+    if (load_index_file(INDEX_FILE, sorted_ind_arr)) {
+        LATENCY_END(OP_LOAD, load_started);
+        fprintf(log, "Sorted index loaded from 'database.idx'\n");
+    } else {
+        fill_date_column();
+        LATENCY_END(OP_LOAD, load_started);
+        LATENCY_START(sort_started);
+        
+        fprintf(log, "Sorting data by street and house number using %s (%d thread%s)...\n",
+                sort_method == SORT_RADIX ? "Radix Sort" : "Heap Sort",
+                sort_threads, sort_threads == 1 ? "" : "s");
+        if (!sort_index(sorted_ind_arr, record_count)) {
+            fprintf(log, "Error: not enough memory to sort %d records\n", record_count);
+            free_date_column();
+            free(unsorted_ind_arr);
+            free(sorted_ind_arr);
+            unmap_database(&database);
+            return 1;
+        }
+        
+        if (!build_prefix_directory(&prefix_directory, sorted_ind_arr, record_count)) {
+            fprintf(log, "Warning: not enough memory for the prefix directory, using binary search\n");
+        }
+        LATENCY_END(OP_SORT, sort_started);
+        
+        if (!save_index_file(INDEX_FILE, sorted_ind_arr)) {
+            fprintf(log, "Warning: could not write 'database.idx', the next start will sort again\n");
+        }
+    }
     
-    while (root) {
-        Node *temp = root;
-        root = root->next;
-        free(temp);
+    fprintf(log, "Data loaded successfully. Total records: %d\n", record_count);
+    record_capacity = record_count;
+    index_database = sorted_ind_arr;
+    int result = 0;
+    if (batch) {
+        result = run_batch(batch_file, &unsorted_ind_arr, &sorted_ind_arr);
+    } else if (export_format != EXPORT_NONE) {
+        result = run_export(export_format, export_sorted ? sorted_ind_arr : unsorted_ind_arr, export_file);
+    } else {
+        init_console();
+        printf("Press any key to continue...");
+        getchar();
+        mainloop(&unsorted_ind_arr, &sorted_ind_arr);
     }
     
-    printf("Program finished.\n");
-    return 0;
+    if (database_changed && !save_index_file(INDEX_FILE, sorted_ind_arr)) {
+        fprintf(log, "Warning: could not update '%s'\n", INDEX_FILE);
+    }
+#ifdef INSTRUMENT
+    if (!save_stats(stats_file)) {
+        fprintf(log, "Warning: could not write '%s'\n", stats_file);
+    }
+#endif
+    
+    free_prefix_directory(&prefix_directory);
+    free_date_column();
+    free_display_cache();
+    free(unsorted_ind_arr);
+    free(sorted_ind_arr);
+    unmap_database(&database);
+    
+    if (interactive) {
+        printf("Program finished.\n");
+    }
+    return result;
 }
\ No newline at end of file
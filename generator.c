@@ -0,0 +1,309 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define MAX_STR_SIZE 32
+#define STREET_SIZE 18
+#define DATE_SIZE 10
+#define BLOCK_RECORDS 4096
+#define DATE_CLUSTERS 12
+#define CLUSTER_SPREAD 60
+#define ZIPF_EXPONENT 1.1
+
+// Та же 64-байтовая запись, что и в courswork.c
+typedef struct {
+    char fio[MAX_STR_SIZE];
+    char street[STREET_SIZE];
+    short int home;
+    short int appartament;
+    char date[DATE_SIZE];
+} Record;
+
+// Таблицы в UTF-8, при запуске переводятся в CP866
+const char* surnames[] = {
+    "Иванов", "Петров", "Смирнов", "Кузнецов", "Попов", "Васильев", "Соколов",
+    "Михайлов", "Новиков", "Федоров", "Морозов", "Волков", "Алексеев", "Лебедев",
+    "Семенов", "Егоров", "Павлов", "Козлов", "Степанов", "Николаев", "Орлов",
+    "Андреев", "Макаров", "Никитин", "Захаров", "Зайцев", "Соловьев", "Борисов",
+    "Яковлев", "Григорьев", "Романов", "Воробьев", "Сергеев", "Кузьмин", "Фролов",
+    "Александров", "Дмитриев", "Королев", "Гусев", "Киселев", "Ильин", "Максимов",
+    "Поляков", "Сорокин", "Виноградов", "Ковалев", "Белов", "Медведев", "Антонов",
+    "Тарасов", "Жуков", "Баранов", "Филиппов", "Комаров", "Давыдов", "Беляев",
+    "Герасимов", "Богданов", "Осипов", "Сидоров", "Матвеев", "Титов", "Марков",
+    "Миронов", "Крылов", "Куликов", "Карпов", "Власов", "Мельников", "Денисов",
+    "Гаврилов", "Тихонов", "Казаков", "Афанасьев", "Данилов", "Савельев", "Тимофеев",
+    "Фомин", "Чернов", "Абрамов", "Мартынов", "Ефимов", "Федотов", "Щербаков",
+    "Назаров", "Калинин", "Исаев", "Чернышев", "Быков", "Маслов", "Родионов",
+    "Коновалов", "Лазарев", "Воронин", "Климов", "Филатов", "Пономарев", "Голубев",
+    "Кудрявцев", "Прохоров", "Наумов", "Потапов", "Журавлев", "Овчинников", "Трофимов"
+};
+
+const char* male_names[] = {
+    "Александр", "Алексей", "Андрей", "Антон", "Артем", "Борис", "Вадим", "Валерий",
+    "Василий", "Виктор", "Владимир", "Глеб", "Григорий", "Даниил", "Денис", "Дмитрий",
+    "Евгений", "Егор", "Иван", "Игорь", "Илья", "Кирилл", "Константин", "Лев",
+    "Максим", "Михаил", "Никита", "Николай", "Олег", "Павел", "Петр", "Роман",
+    "Семен", "Сергей", "Степан", "Тимофей", "Федор", "Юрий", "Ярослав"
+};
+
+const char* female_names[] = {
+    "Александра", "Алина", "Алла", "Анастасия", "Анна", "Валентина", "Валерия",
+    "Вера", "Виктория", "Галина", "Дарья", "Евгения", "Екатерина", "Елена",
+    "Елизавета", "Жанна", "Зоя", "Ирина", "Ксения", "Лариса", "Любовь", "Людмила",
+    "Маргарита", "Марина", "Мария", "Надежда", "Наталья", "Нина", "Ольга",
+    "Полина", "Светлана", "София", "Тамара", "Татьяна", "Юлия"
+};
+
+// Основы отчеств: к ним добавляется "ич" или "на"
+const char* patronymics[] = {
+    "Александров", "Алексеев", "Андреев", "Антонов", "Борисов", "Вадимов",
+    "Васильев", "Викторов", "Владимиров", "Глебов", "Григорьев", "Денисов",
+    "Дмитриев", "Евгеньев", "Егоров", "Иванов", "Игорев", "Кириллов",
+    "Константинов", "Максимов", "Михайлов", "Николаев", "Олегов", "Павлов",
+    "Петров", "Романов", "Семенов", "Сергеев", "Степанов", "Тимофеев",
+    "Федоров", "Юрьев", "Ярославов"
+};
+
+// Порядок задает популярность: первая улица встречается чаще всех
+const char* streets[] = {
+    "Ленина", "Советская", "Мира", "Молодежная", "Центральная", "Школьная",
+    "Садовая", "Лесная", "Новая", "Набережная", "Гагарина", "Пушкина",
+    "Кирова", "Октябрьская", "Заречная", "Первомайская", "Полевая", "Комсомольская",
+    "Пролетарская", "Северная", "Южная", "Степная", "Зеленая", "Береговая",
+    "Луговая", "Чапаева", "Строителей", "Рабочая", "Солнечная", "Островского",
+    "Маяковского", "Лермонтова", "Чехова", "Горького", "Некрасова", "Калинина",
+    "Свердлова", "Фрунзе", "Победы", "Дзержинского", "Куйбышева", "Мичурина",
+    "Суворова", "Кутузова", "Энгельса", "Жукова", "Вокзальная", "Парковая",
+    "Нагорная", "Никитина", "Ломоносова", "Тургенева", "Циолковского", "Шевченко"
+};
+
+// Окончания женской фамилии и отчеств
+const char* suffixes[] = {"а", "ич", "на"};
+
+#define COUNT(table) ((int)(sizeof(table) / sizeof((table)[0])))
+
+uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+// xorshift64*: быстрый и одинаковый на всех платформах, в отличие от rand()
+uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+double random_unit(void) {
+    return (double)(next_random() >> 11) / 9007199254740992.0;
+}
+
+int random_below(int n) {
+    return (int)(random_unit() * n);
+}
+
+// Перевод UTF-8 в CP866: кириллица и ASCII, прочие символы заменяются на '?'
+char* utf8_to_cp866(const char* text) {
+    char* result = (char*)malloc(strlen(text) + 1);
+    if (result == NULL) {
+        return NULL;
+    }
+    const unsigned char* s = (const unsigned char*)text;
+    size_t length = 0;
+    while (*s) {
+        if (*s < 0x80) {
+            result[length++] = (char)*s++;
+            continue;
+        }
+        unsigned int code = '?';
+        if ((s[0] & 0xE0) == 0xC0 && (s[1] & 0xC0) == 0x80) {
+            code = ((s[0] & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+            s += 2;
+        } else {
+            s++;
+        }
+        if (code >= 0x410 && code <= 0x43F) {
+            result[length++] = (char)(0x80 + (code - 0x410));
+        } else if (code >= 0x440 && code <= 0x44F) {
+            result[length++] = (char)(0xE0 + (code - 0x440));
+        } else if (code == 0x401) {
+            result[length++] = (char)0xF0;
+        } else if (code == 0x451) {
+            result[length++] = (char)0xF1;
+        } else {
+            result[length++] = '?';
+        }
+    }
+    result[length] = '\0';
+    return result;
+}
+
+int convert_table(const char* table[], int count) {
+    for (int i = 0; i < count; i++) {
+        table[i] = utf8_to_cp866(table[i]);
+        if (table[i] == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Поля в базе дополнены пробелами и заканчиваются нулевым байтом
+void fill_field(char* field, size_t size, const char* text) {
+    size_t length = strlen(text);
+    memset(field, ' ', size - 1);
+    memcpy(field, text, length < size - 1 ? length : size - 1);
+    field[size - 1] = '\0';
+}
+
+// Номера дней от 1970-01-01 (алгоритм Хиннанта)
+int64_t days_from_civil(int y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = (int)(y - era * 400);
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+void civil_from_days(int64_t z, int* y, int* m, int* d) {
+    z += 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int doe = (int)(z - era * 146097);
+    int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int mp = (5 * doy + 2) / 153;
+    *d = doy - (153 * mp + 2) / 5 + 1;
+    *m = mp + (mp < 10 ? 3 : -9);
+    *y = (int)(yoe + era * 400) + (*m <= 2);
+}
+
+// Распределение Ципфа: вероятность i-й улицы пропорциональна 1 / (i + 1)^s
+double* build_zipf_cdf(int n, double exponent) {
+    double* cdf = (double*)malloc(n * sizeof(double));
+    if (cdf == NULL) {
+        return NULL;
+    }
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) {
+        sum += 1.0 / pow(i + 1, exponent);
+        cdf[i] = sum;
+    }
+    for (int i = 0; i < n; i++) {
+        cdf[i] /= sum;
+    }
+    return cdf;
+}
+
+int zipf_pick(const double cdf[], int n) {
+    double u = random_unit();
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void make_record(Record* record, const double street_cdf[], const int64_t clusters[],
+                 int64_t first_day, int64_t last_day) {
+    char fio[3 * MAX_STR_SIZE];
+    const char* surname = surnames[random_below(COUNT(surnames))];
+    const char* patronymic = patronymics[random_below(COUNT(patronymics))];
+    if (random_below(2)) {
+        snprintf(fio, sizeof(fio), "%s %s %s%s", surname,
+                 male_names[random_below(COUNT(male_names))], patronymic, suffixes[1]);
+    } else {
+        snprintf(fio, sizeof(fio), "%s%s %s %s%s", surname, suffixes[0],
+                 female_names[random_below(COUNT(female_names))], patronymic, suffixes[2]);
+    }
+    fill_field(record->fio, MAX_STR_SIZE, fio);
+
+    fill_field(record->street, STREET_SIZE, streets[zipf_pick(street_cdf, COUNT(streets))]);
+
+    // Малые номера домов встречаются чаще больших
+    double u = random_unit();
+    record->home = (short int)(1 + (int)(150 * u * u));
+    record->appartament = (short int)(1 + random_below(300));
+
+    // Даты группируются вокруг нескольких центров, отклонение примерно нормальное
+    double offset = (random_unit() + random_unit() + random_unit() - 1.5) * CLUSTER_SPREAD * 2;
+    int64_t day = clusters[random_below(DATE_CLUSTERS)] + (int64_t)offset;
+    if (day < first_day) day = first_day;
+    if (day > last_day) day = last_day;
+    int y, m, d;
+    civil_from_days(day, &y, &m, &d);
+    char date[DATE_SIZE + 1];
+    snprintf(date, sizeof(date), "%02d-%02d-%02d", d, m, y % 100);
+    fill_field(record->date, DATE_SIZE, date);
+}
+
+int main(int argc, char* argv[]) {
+    long count = -1;
+    const char* output_filename = "database.dat";
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--seed=", 7) == 0) {
+            rng_state = strtoull(argv[i] + 7, NULL, 10) * 0x9E3779B97F4A7C15ULL + 1;
+        } else if (count < 0) {
+            count = atol(argv[i]);
+        } else {
+            output_filename = argv[i];
+        }
+    }
+    if (count <= 0 || count > INT32_MAX) {
+        printf("Использование: %s <количество_записей> [файл] [--seed=N]\n", argv[0]);
+        return 1;
+    }
+
+    if (!convert_table(surnames, COUNT(surnames)) || !convert_table(male_names, COUNT(male_names)) ||
+        !convert_table(female_names, COUNT(female_names)) ||
+        !convert_table(patronymics, COUNT(patronymics)) || !convert_table(suffixes, COUNT(suffixes)) ||
+        !convert_table(streets, COUNT(streets))) {
+        printf("Ошибка: недостаточно памяти\n");
+        return 1;
+    }
+
+    double* street_cdf = build_zipf_cdf(COUNT(streets), ZIPF_EXPONENT);
+    Record* block = (Record*)malloc(BLOCK_RECORDS * sizeof(Record));
+    FILE* file = fopen(output_filename, "wb");
+    if (street_cdf == NULL || block == NULL || file == NULL) {
+        printf("Ошибка: невозможно создать файл %s\n", output_filename);
+        free(street_cdf);
+        free(block);
+        if (file) fclose(file);
+        return 1;
+    }
+
+    int64_t first_day = days_from_civil(1990, 1, 1);
+    int64_t last_day = days_from_civil(1999, 12, 31);
+    int64_t clusters[DATE_CLUSTERS];
+    for (int i = 0; i < DATE_CLUSTERS; i++) {
+        clusters[i] = first_day + random_below((int)(last_day - first_day + 1));
+    }
+
+    for (long written = 0; written < count; ) {
+        int n = count - written < BLOCK_RECORDS ? (int)(count - written) : BLOCK_RECORDS;
+        for (int i = 0; i < n; i++) {
+            make_record(&block[i], street_cdf, clusters, first_day, last_day);
+        }
+        if (fwrite(block, sizeof(Record), n, file) != (size_t)n) {
+            printf("Ошибка записи в файл %s\n", output_filename);
+            fclose(file);
+            free(street_cdf);
+            free(block);
+            return 1;
+        }
+        written += n;
+    }
+
+    fclose(file);
+    free(street_cdf);
+    free(block);
+    printf("Записано %ld записей в %s\n", count, output_filename);
+    return 0;
+}
\ No newline at end of file